@@ -0,0 +1,102 @@
+#ifndef AFFINE_TRANSFORMATION_HPP
+#define	AFFINE_TRANSFORMATION_HPP
+
+#include <assimp/types.h>
+
+//Define SKELETAL_ANIMATION_MODEL_NO_SIMD before including to use the scalar code paths, for instance to compare them with SSE or NEON
+#if defined(SKELETAL_ANIMATION_MODEL_NO_SIMD)
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=1)
+#include <xmmintrin.h>
+#define SKELETAL_ANIMATION_MODEL_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SKELETAL_ANIMATION_MODEL_NEON
+#endif
+
+//Single precision affine transformation used on the hot path of SkeletalAnimationModel,
+//converted from and to aiMatrix4x4 where the bone matrices are stored.
+//The 3x4 matrix is stored column by column, each column padded to 16 bytes:
+//a1 b1 c1 0 a2 b2 c2 0 a3 b3 c3 0 a4 b4 c4 1
+//which is also a column-major 4x4 matrix, as expected by OpenGL, and the bone palette layout of skinBoneInfluences.
+class alignas(16) AffineTransformation {
+public:
+    float columns[16];
+
+    AffineTransformation() {
+        for(unsigned int c=0;c<16;c++)
+            columns[c]=(c%5==0) ? 1.0 : 0.0;
+    }
+
+    //The last row of matrix is assumed to be 0 0 0 1
+    explicit AffineTransformation(const aiMatrix4x4& matrix) {
+        for(unsigned int c=0;c<4;c++) {
+            columns[c*4]=matrix[0][c];
+            columns[c*4+1]=matrix[1][c];
+            columns[c*4+2]=matrix[2][c];
+            columns[c*4+3]=(c==3) ? 1.0 : 0.0;
+        }
+    }
+
+    aiMatrix4x4 matrix() const {
+        return aiMatrix4x4(columns[0], columns[4], columns[8], columns[12],
+                           columns[1], columns[5], columns[9], columns[13],
+                           columns[2], columns[6], columns[10], columns[14],
+                           0.0, 0.0, 0.0, 1.0);
+    }
+
+    AffineTransformation operator*(const AffineTransformation& other) const {
+        AffineTransformation result;
+#if defined(SKELETAL_ANIMATION_MODEL_SSE)
+        __m128 column0=_mm_load_ps(columns), column1=_mm_load_ps(columns+4);
+        __m128 column2=_mm_load_ps(columns+8), column3=_mm_load_ps(columns+12);
+        for(unsigned int c=0;c<4;c++) {
+            const float* otherColumn=other.columns+c*4;
+            _mm_store_ps(result.columns+c*4,
+                         _mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(otherColumn[0])), _mm_mul_ps(column1, _mm_set1_ps(otherColumn[1]))),
+                                    _mm_add_ps(_mm_mul_ps(column2, _mm_set1_ps(otherColumn[2])), _mm_mul_ps(column3, _mm_set1_ps(otherColumn[3])))));
+        }
+#elif defined(SKELETAL_ANIMATION_MODEL_NEON)
+        float32x4_t column0=vld1q_f32(columns), column1=vld1q_f32(columns+4);
+        float32x4_t column2=vld1q_f32(columns+8), column3=vld1q_f32(columns+12);
+        for(unsigned int c=0;c<4;c++) {
+            const float* otherColumn=other.columns+c*4;
+            float32x4_t resultColumn=vmulq_n_f32(column0, otherColumn[0]);
+            resultColumn=vmlaq_n_f32(resultColumn, column1, otherColumn[1]);
+            resultColumn=vmlaq_n_f32(resultColumn, column2, otherColumn[2]);
+            resultColumn=vmlaq_n_f32(resultColumn, column3, otherColumn[3]);
+            vst1q_f32(result.columns+c*4, resultColumn);
+        }
+#else
+        for(unsigned int c=0;c<4;c++) {
+            for(unsigned int cr=0;cr<4;cr++) {
+                result.columns[c*4+cr]=columns[cr]*other.columns[c*4]+columns[4+cr]*other.columns[c*4+1]+
+                                       columns[8+cr]*other.columns[c*4+2]+columns[12+cr]*other.columns[c*4+3];
+            }
+        }
+#endif
+        return result;
+    }
+
+    //Linear interpolation of each element, for instance between nearby frames of a BakedAnimation
+    AffineTransformation interpolate(const AffineTransformation& other, float factor) const {
+        AffineTransformation result;
+        for(unsigned int c=0;c<16;c++)
+            result.columns[c]=columns[c]+(other.columns[c]-columns[c])*factor;
+        return result;
+    }
+
+    aiVector3D transformPoint(const aiVector3D& point) const {
+        return aiVector3D(columns[0]*point.x+columns[4]*point.y+columns[8]*point.z+columns[12],
+                          columns[1]*point.x+columns[5]*point.y+columns[9]*point.z+columns[13],
+                          columns[2]*point.x+columns[6]*point.y+columns[10]*point.z+columns[14]);
+    }
+
+    //Transforms normal with the upper 3x3 matrix
+    aiVector3D transformNormal(const aiVector3D& normal) const {
+        return aiVector3D(columns[0]*normal.x+columns[4]*normal.y+columns[8]*normal.z,
+                          columns[1]*normal.x+columns[5]*normal.y+columns[9]*normal.z,
+                          columns[2]*normal.x+columns[6]*normal.y+columns[10]*normal.z);
+    }
+};
+
+#endif	/* AFFINE_TRANSFORMATION_HPP */
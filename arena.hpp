@@ -0,0 +1,201 @@
+#ifndef ARENA_HPP
+#define	ARENA_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+//Mutex that does nothing, for arenas used by one thread, see LocalArena
+class NullMutex {
+public:
+    void lock() {}
+    void unlock() {}
+};
+
+//Monotonic memory arena: allocations are carved out of large blocks in order, and deallocating does nothing.
+//All the memory is freed at once when the arena is released or destroyed, or reused after reset.
+//Each call locks Mutex: Arena is thread safe, and LocalArena, for instance thread_local, is not synchronized.
+//Arena is used through ArenaAllocator for the static data of a model, see ArenaMeshExtended,
+//and through ArenaScope for per-frame scratch buffers.
+template<class Mutex>
+class BasicArena {
+public:
+    //Where the next allocation is made, see position and rewind
+    class Position {
+        friend class BasicArena;
+        size_t blockId=0;
+        size_t offset=0;
+    };
+
+private:
+    class Block {
+    public:
+        std::unique_ptr<char[]> data;
+        size_t size;
+
+        Block(size_t size): data(new char[size]), size(size) {}
+    };
+
+    std::vector<Block> blocks;
+    size_t blockSize;
+    Position current;
+    Mutex mutex;
+
+public:
+    //Blocks of blockSize bytes are allocated as needed, or larger for larger allocations
+    explicit BasicArena(size_t blockSize=1<<20): blockSize(blockSize) {}
+
+    BasicArena(const BasicArena&)=delete;
+    BasicArena& operator=(const BasicArena&)=delete;
+
+    //Returns size bytes aligned to alignment, a power of two. Valid until reset, rewind before the allocation, release or destruction.
+    void* allocate(size_t size, size_t alignment) {
+        std::lock_guard<Mutex> lock(mutex);
+        while(true) {
+            //Blocks after the current one are reused after reset or rewind, and skipped if too small
+            if(current.blockId<blocks.size()) {
+                auto& block=blocks[current.blockId];
+                uintptr_t address=reinterpret_cast<uintptr_t>(block.data.get())+current.offset;
+                size_t padding=(alignment-address%alignment)%alignment;
+                if(padding+size<=block.size-current.offset) {
+                    void* pointer=block.data.get()+current.offset+padding;
+                    current.offset+=padding+size;
+                    return pointer;
+                }
+                current.blockId++;
+                current.offset=0;
+                continue;
+            }
+            blocks.emplace_back(std::max(blockSize, size+alignment));
+        }
+    }
+
+    Position position() {
+        std::lock_guard<Mutex> lock(mutex);
+        return current;
+    }
+
+    //Makes the memory allocated since the given position available again, see ArenaScope.
+    //Rewinding to the start, as reset does, merges the blocks into one block of their total size,
+    //so that blocks skipped as too small are not kept, and the same allocations then fit in one block.
+    void rewind(const Position& position) {
+        std::lock_guard<Mutex> lock(mutex);
+        current=position;
+        if(current.blockId==0 && current.offset==0 && blocks.size()>1) {
+            size_t size=0;
+            for(auto& block: blocks)
+                size+=block.size;
+            blocks.clear();
+            blocks.emplace_back(size);
+        }
+    }
+
+    //Makes all the memory available again, keeping the memory of the blocks. For instance once per frame for a frame arena.
+    void reset() {
+        rewind(Position());
+    }
+
+    //Frees all the blocks
+    void release() {
+        std::lock_guard<Mutex> lock(mutex);
+        blocks.clear();
+        current=Position();
+    }
+
+    //Bytes in the allocated blocks
+    size_t capacity() {
+        std::lock_guard<Mutex> lock(mutex);
+        size_t capacity=0;
+        for(auto& block: blocks)
+            capacity+=block.size;
+        return capacity;
+    }
+};
+
+typedef BasicArena<std::mutex> Arena;
+typedef BasicArena<NullMutex> LocalArena;
+
+//Scratch allocations from an arena, which is rewound to where it was when the scope is destroyed.
+//Scopes can be nested, and must be destroyed in reverse order.
+template<class ArenaType>
+class BasicArenaScope {
+    ArenaType& arena;
+    typename ArenaType::Position start;
+
+public:
+    explicit BasicArenaScope(ArenaType& arena): arena(arena), start(arena.position()) {}
+
+    ~BasicArenaScope() {
+        arena.rewind(start);
+    }
+
+    BasicArenaScope(const BasicArenaScope&)=delete;
+    BasicArenaScope& operator=(const BasicArenaScope&)=delete;
+
+    //Returns size default constructed values, valid until the scope is destroyed.
+    //T must be trivially destructible, since the values are not destroyed.
+    template<class T>
+    T* allocate(size_t size) {
+        static_assert(std::is_trivially_destructible<T>::value, "ArenaScope: type must be trivially destructible");
+        T* values=static_cast<T*>(arena.allocate(std::max<size_t>(size, 1)*sizeof(T), alignof(T)));
+        for(size_t c=0;c<size;c++)
+            new(values+c) T();
+        return values;
+    }
+};
+
+typedef BasicArenaScope<Arena> ArenaScope;
+typedef BasicArenaScope<LocalArena> LocalArenaScope;
+
+//Standard allocator allocating from an Arena, for instance for the vectors of ArenaMesh and ArenaMeshExtended.
+//Default constructed, it allocates from the heap instead, as std::allocator.
+//The arena must outlive the containers using it.
+template<class T>
+class ArenaAllocator {
+    template<class U> friend class ArenaAllocator;
+    Arena* arena;
+
+public:
+    typedef T value_type;
+
+    ArenaAllocator() noexcept: arena(nullptr) {}
+    ArenaAllocator(Arena& arena) noexcept: arena(&arena) {}
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& allocator) noexcept: arena(allocator.arena) {}
+
+    T* allocate(size_t size) {
+        if(!arena)
+            return static_cast<T*>(::operator new(size*sizeof(T)));
+        return static_cast<T*>(arena->allocate(size*sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* pointer, size_t size) noexcept {
+        if(!arena)
+            ::operator delete(pointer);
+    }
+
+    Arena* getArena() const {
+        return arena;
+    }
+
+    //Copies of containers allocate from the heap, as std::pmr::polymorphic_allocator does, since they may outlive the arena
+    ArenaAllocator select_on_container_copy_construction() const {
+        return ArenaAllocator();
+    }
+
+    template<class U>
+    bool operator==(const ArenaAllocator<U>& allocator) const {
+        return arena==allocator.arena;
+    }
+    template<class U>
+    bool operator!=(const ArenaAllocator<U>& allocator) const {
+        return arena!=allocator.arena;
+    }
+};
+
+#endif	/* ARENA_HPP */
@@ -0,0 +1,266 @@
+#include "skeletal_animation_model.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+//Headless tool for the asset pipeline: reads models with Assimp in parallel, optionally compresses and bakes their animations,
+//and writes baked files (see SkeletalAnimationModel::writeBaked) that are read at startup with readBaked, without Assimp.
+//Does not need a window or an OpenGL context. Run without arguments for usage.
+
+class Options {
+public:
+    std::vector<std::string> inputs;
+    //Empty to write each baked file next to its model file
+    std::string outputDirectory;
+    std::string extension=".dae";
+    //Frames per second of the pre-sampled global bone transformations, see SkeletalAnimationModel::bakeAnimations. 0 to not bake.
+    double framesPerSecond=30.0;
+    bool compress=false;
+    bool optimizeMeshes=false;
+    unsigned int numThreads=0;
+};
+
+//Result of baking one model file
+class Asset {
+public:
+    std::string input;
+    std::string output;
+    std::string error;
+
+    double readSeconds=0.0;
+    double bakeSeconds=0.0;
+    double writeSeconds=0.0;
+
+    size_t numMeshes=0;
+    size_t numVertices=0;
+    size_t numBones=0;
+    size_t numAnimations=0;
+    //Memory used by the model data after baking, see modelBytes
+    size_t modelBytes=0;
+    size_t fileBytes=0;
+};
+
+void printUsage() {
+    std::printf("Usage: bake_models [options] <model file or directory>...\n"
+                "Reads each model file, and each model file found in the given directories, and writes <name>.baked\n"
+                "Options:\n"
+                "  -o <directory>    write the baked files to directory instead of next to the model files\n"
+                "  -e <extension>    extension of the model files found in directories (default .dae)\n"
+                "  -fps <rate>       frames per second of the baked animations, 0 to not bake them (default 30)\n"
+                "  -compress         reduce and compress the animation keys, see Animation::compress\n"
+                "  -optimize         reorder the meshes for the vertex caches, see Model::optimizeMeshes\n"
+                "  -threads <count>  number of threads reading models (default: hardware threads)\n");
+}
+
+//Returns false if the arguments are invalid
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for(int ca=1;ca<argc;ca++) {
+        std::string argument=argv[ca];
+        bool hasValue=ca+1<argc;
+        if(argument=="-o" && hasValue)
+            options.outputDirectory=argv[++ca];
+        else if(argument=="-e" && hasValue)
+            options.extension=argv[++ca];
+        else if(argument=="-fps" && hasValue)
+            options.framesPerSecond=std::atof(argv[++ca]);
+        else if(argument=="-threads" && hasValue)
+            options.numThreads=std::atoi(argv[++ca]);
+        else if(argument=="-compress")
+            options.compress=true;
+        else if(argument=="-optimize")
+            options.optimizeMeshes=true;
+        else if(!argument.empty() && argument[0]=='-')
+            return false;
+        else
+            options.inputs.emplace_back(argument);
+    }
+    return !options.inputs.empty() && options.framesPerSecond>=0.0;
+}
+
+bool endsWith(const std::string& value, const std::string& suffix) {
+    return value.size()>=suffix.size() && std::equal(suffix.rbegin(), suffix.rend(), value.rbegin());
+}
+
+//Adds the files in directory and its subdirectories ending with extension, or adds path itself if it is not a directory
+void findFiles(const std::string& path, const std::string& extension, std::vector<std::string>& files) {
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat status;
+    if(stat(path.c_str(), &status)==0 && S_ISDIR(status.st_mode)) {
+        DIR* directory=opendir(path.c_str());
+        if(!directory)
+            return;
+        std::vector<std::string> entries;
+        while(dirent* entry=readdir(directory)) {
+            std::string name=entry->d_name;
+            if(name!="." && name!="..")
+                entries.emplace_back(path+"/"+name);
+        }
+        closedir(directory);
+        std::sort(entries.begin(), entries.end());
+        for(auto& entry: entries) {
+            if(stat(entry.c_str(), &status)==0 && S_ISDIR(status.st_mode))
+                findFiles(entry, extension, files);
+            else if(endsWith(entry, extension))
+                files.emplace_back(entry);
+        }
+        return;
+    }
+#endif
+    files.emplace_back(path);
+}
+
+//The output file of the given model file: the extension replaced by .baked, in outputDirectory if given
+std::string outputFilename(const std::string& input, const std::string& outputDirectory) {
+    std::string output=input;
+    size_t slash=output.find_last_of("/\\");
+    size_t dot=output.find_last_of('.');
+    if(dot!=std::string::npos && (slash==std::string::npos || dot>slash))
+        output.erase(dot);
+    if(!outputDirectory.empty())
+        output=outputDirectory+"/"+(slash==std::string::npos ? output : output.substr(slash+1));
+    return output+".baked";
+}
+
+template<class T>
+size_t vectorBytes(const std::vector<T>& values) {
+    return values.capacity()*sizeof(T);
+}
+
+//Bytes used by the vertices, indices, bone weights, animation keys and baked animations of the model
+size_t modelBytes(const SkeletalAnimationModel<>& model) {
+    size_t bytes=vectorBytes(model.bones);
+    for(auto& mesh: model.meshes) {
+        bytes+=vectorBytes(mesh.vertices)+vectorBytes(mesh.normals)+vectorBytes(mesh.textureCoords)+vectorBytes(mesh.indices);
+        bytes+=vectorBytes(mesh.boneWeights)+vectorBytes(mesh.boneInfluenceIds)+vectorBytes(mesh.boneInfluenceWeights);
+        for(auto& boneWeights: mesh.boneWeights)
+            bytes+=vectorBytes(boneWeights.weights);
+    }
+    for(auto& animation: model.animations) {
+        bytes+=vectorBytes(animation.channels);
+        for(auto& channel: animation.channels) {
+            bytes+=vectorBytes(channel.positions)+vectorBytes(channel.rotations)+vectorBytes(channel.scales);
+            bytes+=vectorBytes(channel.compressedPositions)+vectorBytes(channel.compressedRotations)+vectorBytes(channel.compressedScales);
+        }
+    }
+    for(auto& bakedAnimation: model.bakedAnimations)
+        bytes+=vectorBytes(bakedAnimation.frames);
+    return bytes;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+//Reads, compresses, bakes and writes one model, with errors stored in asset.error
+void bake(const Options& options, Asset& asset) {
+    try {
+        auto start=std::chrono::steady_clock::now();
+        SkeletalAnimationModel<> model;
+        model.optimizeMeshes=options.optimizeMeshes;
+        model.read(asset.input);
+        asset.readSeconds=secondsSince(start);
+        if(model.meshes.empty() && model.bones.empty()) {
+            asset.error="could not read model";
+            return;
+        }
+
+        start=std::chrono::steady_clock::now();
+        if(options.compress) {
+            for(auto& animation: model.animations)
+                animation.compress();
+        }
+        if(options.framesPerSecond>0.0)
+            model.bakeAnimations(options.framesPerSecond);
+        asset.bakeSeconds=secondsSince(start);
+
+        start=std::chrono::steady_clock::now();
+        model.writeBaked(asset.output);
+        asset.writeSeconds=secondsSince(start);
+
+        asset.numMeshes=model.meshes.size();
+        for(auto& mesh: model.meshes)
+            asset.numVertices+=mesh.vertices.size();
+        asset.numBones=model.bones.size();
+        asset.numAnimations=model.animations.size();
+        asset.modelBytes=modelBytes(model);
+        MappedFile file;
+        if(file.open(asset.output))
+            asset.fileBytes=file.size();
+    }
+    catch(const std::exception& exception) {
+        asset.error=exception.what();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if(!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    if(!options.outputDirectory.empty())
+        mkdir(options.outputDirectory.c_str(), 0755);
+#endif
+
+    std::vector<std::string> files;
+    for(auto& input: options.inputs)
+        findFiles(input, options.extension, files);
+    std::vector<Asset> assets(files.size());
+    for(unsigned int cf=0;cf<files.size();cf++) {
+        assets[cf].input=files[cf];
+        assets[cf].output=outputFilename(files[cf], options.outputDirectory);
+    }
+
+    auto start=std::chrono::steady_clock::now();
+    {
+        //The main thread also reads models while waiting
+        JobSystem jobSystem(options.numThreads>0 ? options.numThreads-1 : std::max(std::thread::hardware_concurrency(), 2u)-1);
+        JobSystem::Counter counter;
+        for(auto& asset: assets) {
+            jobSystem.run(counter, [&options, &asset] {
+                bake(options, asset);
+            });
+        }
+        jobSystem.wait(counter);
+    }
+    double totalSeconds=secondsSince(start);
+
+    std::printf("%-40s %6s %9s %6s %10s %9s %9s %9s %11s %10s\n", "model", "meshes", "vertices", "bones", "animations",
+                "read ms", "bake ms", "write ms", "memory KiB", "file KiB");
+    unsigned int numFailed=0;
+    for(auto& asset: assets) {
+        if(!asset.error.empty()) {
+            std::printf("%-40s error: %s\n", asset.input.c_str(), asset.error.c_str());
+            numFailed++;
+            continue;
+        }
+        std::printf("%-40s %6zu %9zu %6zu %10zu %9.1f %9.1f %9.1f %11.1f %10.1f\n", asset.input.c_str(), asset.numMeshes, asset.numVertices,
+                    asset.numBones, asset.numAnimations, asset.readSeconds*1000.0, asset.bakeSeconds*1000.0, asset.writeSeconds*1000.0,
+                    asset.modelBytes/1024.0, asset.fileBytes/1024.0);
+    }
+    std::printf("%zu models baked, %u failed, in %.1f ms\n", assets.size()-numFailed, numFailed, totalSeconds*1000.0);
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage)==0) {
+#if defined(__APPLE__)
+        std::printf("peak resident memory: %.1f MiB\n", usage.ru_maxrss/(1024.0*1024.0));
+#else
+        std::printf("peak resident memory: %.1f MiB\n", usage.ru_maxrss/1024.0);
+#endif
+    }
+#endif
+
+    return numFailed>0 ? 1 : 0;
+}
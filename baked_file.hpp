@@ -0,0 +1,184 @@
+#ifndef BAKED_FILE_HPP
+#define	BAKED_FILE_HPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+#include <assimp/types.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Binary files written with Model::writeBaked and SkeletalAnimationModel::writeBaked, and read back without Assimp.
+//Arrays are stored in their in-memory layout, so that each array is read with a single memcpy.
+//The files are therefore only portable between builds with the same Assimp types and byte order.
+#define BAKED_FILE_VERSION 4
+
+//Writes values and arrays of trivially copyable types to a file
+class BakedWriter {
+    std::ofstream file;
+
+public:
+    BakedWriter(const std::string& filename): file(filename, std::ios::binary) {
+        if(!file)
+            throw std::runtime_error("BakedWriter: could not open "+filename);
+
+        file.write("SALB", 4);
+        write<uint32_t>(BAKED_FILE_VERSION);
+        write<uint32_t>(0x01020304); //byte order
+        write<uint32_t>(sizeof(aiVector3D));
+    }
+
+    template<class T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "BakedWriter: type must be trivially copyable");
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<class T, class Allocator>
+    void writeArray(const std::vector<T, Allocator>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "BakedWriter: type must be trivially copyable");
+        write<uint64_t>(values.size());
+        file.write(reinterpret_cast<const char*>(values.data()), values.size()*sizeof(T));
+    }
+
+    void writeString(const std::string& value) {
+        write<uint64_t>(value.size());
+        file.write(value.data(), value.size());
+    }
+
+    void close() {
+        file.close();
+        if(!file)
+            throw std::runtime_error("BakedWriter: could not write file");
+    }
+};
+
+//Read-only view of a whole file, memory mapped where supported
+class MappedFile {
+    const char* mappedData;
+    size_t mappedSize;
+    std::vector<char> buffer;
+
+public:
+    MappedFile(): mappedData(nullptr), mappedSize(0) {}
+
+    //Returns false if the file could not be opened
+    bool open(const std::string& filename) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fileDescriptor=::open(filename.c_str(), O_RDONLY);
+        if(fileDescriptor<0)
+            return false;
+        struct stat fileStatus;
+        if(fstat(fileDescriptor, &fileStatus)!=0) {
+            ::close(fileDescriptor);
+            return false;
+        }
+        mappedSize=fileStatus.st_size;
+        if(mappedSize>0) {
+            void* mapping=mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+            if(mapping==MAP_FAILED) {
+                ::close(fileDescriptor);
+                mappedSize=0;
+                return false;
+            }
+            mappedData=static_cast<const char*>(mapping);
+        }
+        ::close(fileDescriptor);
+        return true;
+#else
+        std::ifstream file(filename, std::ios::binary|std::ios::ate);
+        if(!file)
+            return false;
+        buffer.resize(file.tellg());
+        file.seekg(0);
+        file.read(buffer.data(), buffer.size());
+        mappedData=buffer.data();
+        mappedSize=buffer.size();
+        return true;
+#endif
+    }
+
+    ~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+        if(mappedData)
+            munmap(const_cast<char*>(mappedData), mappedSize);
+#endif
+    }
+
+    MappedFile(const MappedFile&)=delete;
+    MappedFile& operator=(const MappedFile&)=delete;
+
+    const char* data() const {return mappedData;}
+    size_t size() const {return mappedSize;}
+};
+
+//Reads values and arrays written by BakedWriter from memory
+class BakedReader {
+    const char* data;
+    size_t size;
+    size_t position;
+
+    const char* advance(size_t numBytes) {
+        if(numBytes>size-position)
+            throw std::runtime_error("BakedReader: unexpected end of file");
+        const char* pointer=data+position;
+        position+=numBytes;
+        return pointer;
+    }
+
+public:
+    BakedReader(const char* data, size_t size): data(data), size(size), position(0) {
+        if(size<4 || std::memcmp(advance(4), "SALB", 4)!=0)
+            throw std::runtime_error("BakedReader: not a baked model file");
+        if(read<uint32_t>()!=BAKED_FILE_VERSION)
+            throw std::runtime_error("BakedReader: unsupported file version");
+        if(read<uint32_t>()!=0x01020304 || read<uint32_t>()!=sizeof(aiVector3D))
+            throw std::runtime_error("BakedReader: file was written on an incompatible platform");
+    }
+
+    template<class T>
+    T read() {
+        static_assert(std::is_trivially_copyable<T>::value, "BakedReader: type must be trivially copyable");
+        T value;
+        std::memcpy(&value, advance(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    //Reads a number of elements, each written with at least minElementSize bytes.
+    //Throws std::runtime_error if the rest of the file is too small, before containers are resized to a corrupt size.
+    uint64_t readCount(size_t minElementSize) {
+        uint64_t count=read<uint64_t>();
+        if(count>(size-position)/minElementSize)
+            throw std::runtime_error("BakedReader: unexpected end of file");
+        return count;
+    }
+
+    template<class T, class Allocator>
+    void readArray(std::vector<T, Allocator>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "BakedReader: type must be trivially copyable");
+        uint64_t numValues=read<uint64_t>();
+        if(numValues>(size-position)/sizeof(T))
+            throw std::runtime_error("BakedReader: unexpected end of file");
+        values.resize(numValues);
+        if(numValues>0)
+            std::memcpy(values.data(), advance(numValues*sizeof(T)), numValues*sizeof(T));
+    }
+
+    std::string readString() {
+        uint64_t length=read<uint64_t>();
+        const char* pointer=advance(length);
+        return std::string(pointer, length);
+    }
+};
+
+#endif	/* BAKED_FILE_HPP */
@@ -0,0 +1,297 @@
+#include "skeletal_animation_model.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <utility>
+
+//Headless benchmarks of the animation pipeline stages, using the AstroBoy models and synthetic rigs.
+//Run from the directory containing models/, for instance: ./benchmarks --benchmark_filter=getMeshFrame
+
+const std::string modelPath="models/";
+
+//Gives access to SkeletalAnimationModel::readScene for the synthetic scenes.
+//Not named read, which would override SkeletalAnimationModel::read(const aiScene*) called by readScene.
+class SyntheticModel : public SkeletalAnimationModel<> {
+public:
+    void readSynthetic(const aiScene* scene) {
+        readScene(scene, nullptr);
+    }
+};
+
+//Creates a scene with a random bone tree of numBones bones, one mesh of numVertices vertices with 4 bone weights each,
+//and one animation with numKeys keys per bone
+std::unique_ptr<aiScene> createSyntheticScene(unsigned int numBones, unsigned int numVertices, unsigned int numKeys=30) {
+    std::mt19937 random(numBones*7919+numVertices);
+    std::uniform_real_distribution<float> uniform(-1.0, 1.0);
+
+    std::unique_ptr<aiScene> scene(new aiScene());
+    scene->mRootNode=new aiNode();
+    scene->mRootNode->mName.Set("root");
+
+    //Bone cb gets a random parent among the previous bones, or the root node
+    std::vector<aiNode*> nodes(numBones);
+    std::vector<std::vector<aiNode*> > children(numBones+1);
+    for(unsigned int cb=0;cb<numBones;cb++) {
+        nodes[cb]=new aiNode();
+        nodes[cb]->mName.Set("bone"+std::to_string(cb));
+        aiMatrix4x4 translation, rotation;
+        aiMatrix4x4::Translation(aiVector3D(uniform(random), uniform(random), uniform(random)), translation);
+        aiMatrix4x4::RotationZ(uniform(random), rotation);
+        nodes[cb]->mTransformation=translation*rotation;
+
+        unsigned int parentId=(cb==0) ? numBones : random()%cb;
+        nodes[cb]->mParent=(parentId==numBones) ? scene->mRootNode : nodes[parentId];
+        children[parentId].emplace_back(nodes[cb]);
+    }
+    for(unsigned int cb=0;cb<=numBones;cb++) {
+        aiNode* node=(cb==numBones) ? scene->mRootNode : nodes[cb];
+        node->mNumChildren=children[cb].size();
+        node->mChildren=new aiNode*[children[cb].size()];
+        std::copy(children[cb].begin(), children[cb].end(), node->mChildren);
+    }
+
+    scene->mNumMaterials=1;
+    scene->mMaterials=new aiMaterial*[1];
+    scene->mMaterials[0]=new aiMaterial();
+
+    scene->mNumMeshes=1;
+    scene->mMeshes=new aiMesh*[1];
+    aiMesh* mesh=new aiMesh();
+    scene->mMeshes[0]=mesh;
+    mesh->mNumVertices=numVertices;
+    mesh->mVertices=new aiVector3D[numVertices];
+    mesh->mNormals=new aiVector3D[numVertices];
+    for(unsigned int cv=0;cv<numVertices;cv++) {
+        mesh->mVertices[cv]=aiVector3D(uniform(random), uniform(random), uniform(random));
+        mesh->mNormals[cv]=aiVector3D(uniform(random), uniform(random), uniform(random)).Normalize();
+    }
+    mesh->mNumFaces=numVertices/3;
+    mesh->mFaces=new aiFace[mesh->mNumFaces];
+    for(unsigned int cf=0;cf<mesh->mNumFaces;cf++) {
+        mesh->mFaces[cf].mNumIndices=3;
+        mesh->mFaces[cf].mIndices=new unsigned int[3]{cf*3, cf*3+1, cf*3+2};
+    }
+
+    //Each vertex is influenced by 4 neighbouring bones
+    std::vector<std::vector<aiVertexWeight> > weights(numBones);
+    for(unsigned int cv=0;cv<numVertices;cv++) {
+        unsigned int firstBoneId=random()%numBones;
+        for(unsigned int c=0;c<4;c++)
+            weights[(firstBoneId+c)%numBones].emplace_back(cv, 0.4-0.1*c);
+    }
+    mesh->mNumBones=numBones;
+    mesh->mBones=new aiBone*[numBones];
+    for(unsigned int cb=0;cb<numBones;cb++) {
+        aiBone* bone=new aiBone();
+        bone->mName.Set("bone"+std::to_string(cb));
+        aiMatrix4x4::Translation(aiVector3D(uniform(random), uniform(random), uniform(random)), bone->mOffsetMatrix);
+        bone->mNumWeights=weights[cb].size();
+        bone->mWeights=new aiVertexWeight[weights[cb].size()];
+        std::copy(weights[cb].begin(), weights[cb].end(), bone->mWeights);
+        mesh->mBones[cb]=bone;
+    }
+
+    scene->mNumAnimations=1;
+    scene->mAnimations=new aiAnimation*[1];
+    aiAnimation* animation=new aiAnimation();
+    scene->mAnimations[0]=animation;
+    animation->mDuration=numKeys-1;
+    animation->mTicksPerSecond=30.0;
+    animation->mNumChannels=numBones;
+    animation->mChannels=new aiNodeAnim*[numBones];
+    for(unsigned int cc=0;cc<numBones;cc++) {
+        aiNodeAnim* channel=new aiNodeAnim();
+        channel->mNodeName.Set("bone"+std::to_string(cc));
+        channel->mNumPositionKeys=channel->mNumRotationKeys=channel->mNumScalingKeys=numKeys;
+        channel->mPositionKeys=new aiVectorKey[numKeys];
+        channel->mRotationKeys=new aiQuatKey[numKeys];
+        channel->mScalingKeys=new aiVectorKey[numKeys];
+        for(unsigned int ck=0;ck<numKeys;ck++) {
+            channel->mPositionKeys[ck]=aiVectorKey(ck, aiVector3D(uniform(random), uniform(random), uniform(random)));
+            channel->mRotationKeys[ck]=aiQuatKey(ck, aiQuaternion(aiVector3D(uniform(random), uniform(random), uniform(random)).Normalize(), uniform(random)));
+            channel->mScalingKeys[ck]=aiVectorKey(ck, aiVector3D(1.0, 1.0, 1.0));
+        }
+        animation->mChannels[cc]=channel;
+    }
+
+    return scene;
+}
+
+//Synthetic models are created once per size and shared between the benchmarks
+const SyntheticModel& getSyntheticModel(unsigned int numBones, unsigned int numVertices) {
+    static std::map<std::pair<unsigned int, unsigned int>, std::unique_ptr<SyntheticModel> > models;
+    auto& model=models[std::make_pair(numBones, numVertices)];
+    if(!model) {
+        model.reset(new SyntheticModel());
+        model->readSynthetic(createSyntheticScene(numBones, numVertices).get());
+    }
+    return *model;
+}
+
+//Returns nullptr if the model file could not be read
+const SkeletalAnimationModel<>* getAstroBoy() {
+    static std::unique_ptr<SkeletalAnimationModel<> > model;
+    if(!model) {
+        model.reset(new SkeletalAnimationModel<>());
+        model->read(modelPath+"astroBoy_walk_Maya.dae");
+    }
+    return model->meshes.empty() ? nullptr : model.get();
+}
+
+//Time step between frames, 60 frames per second
+const double frameTime=1.0/60.0;
+
+//Interpolates all the channels of the animation, with key cursors as in createFrame
+void interpolate(benchmark::State& state, const SkeletalAnimationModel<>& model) {
+    const auto& animation=model.animations[0];
+    std::vector<Animation::ChannelCursor> cursors(animation.channels.size());
+    double time=0.0;
+    for(auto _: state) {
+        for(unsigned int cc=0;cc<animation.channels.size();cc++) {
+            aiVector3D scale, position;
+            aiQuaternion rotation;
+            animation.interpolate(animation.channels[cc], time, true, cursors[cc], scale, rotation, position);
+            benchmark::DoNotOptimize(position);
+        }
+        time+=frameTime;
+    }
+    state.SetItemsProcessed(state.iterations()*animation.channels.size());
+}
+
+//Samples the animation and updates the global bone transformations
+void createFrame(benchmark::State& state, const SkeletalAnimationModel<>& model) {
+    Pose pose=model.createPose();
+    double time=0.0;
+    for(auto _: state) {
+        model.createFrame(pose, 0, time);
+        benchmark::DoNotOptimize(pose.globalTransformations.data());
+        time+=frameTime;
+    }
+    state.SetItemsProcessed(state.iterations()*model.bones.size());
+}
+
+//Skins all the meshes into reused mesh frames
+void getMeshFrame(benchmark::State& state, const SkeletalAnimationModel<>& model) {
+    Pose pose=model.createPose();
+    model.createFrame(pose, 0, 0.5);
+    std::vector<SkeletalAnimationModel<>::MeshFrame> meshFrames;
+    size_t numVertices=0;
+    for(auto& mesh: model.meshes) {
+        meshFrames.emplace_back(mesh);
+        numVertices+=mesh.vertices.size();
+    }
+    for(auto _: state) {
+        for(auto& meshFrame: meshFrames) {
+            model.getMeshFrame(pose, meshFrame);
+            benchmark::DoNotOptimize(meshFrame.vertices.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations()*numVertices);
+}
+
+//Skins all the meshes into new mesh frames, as getMeshFrame(pose, mesh) does
+void getMeshFrameAllocating(benchmark::State& state, const SkeletalAnimationModel<>& model) {
+    Pose pose=model.createPose();
+    model.createFrame(pose, 0, 0.5);
+    size_t numVertices=0;
+    for(auto& mesh: model.meshes)
+        numVertices+=mesh.vertices.size();
+    for(auto _: state) {
+        for(auto& mesh: model.meshes) {
+            auto meshFrame=model.getMeshFrame(pose, mesh);
+            benchmark::DoNotOptimize(meshFrame.vertices.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations()*numVertices);
+}
+
+//Only constructs the mesh frames, without skinning
+void constructMeshFrame(benchmark::State& state, const SkeletalAnimationModel<>& model) {
+    for(auto _: state) {
+        for(auto& mesh: model.meshes) {
+            SkeletalAnimationModel<>::MeshFrame meshFrame(mesh);
+            benchmark::DoNotOptimize(meshFrame.vertices.data());
+        }
+    }
+}
+
+//Runs the given stage on a synthetic model with state.range(0) bones and state.range(1) vertices
+template<void (*stage)(benchmark::State&, const SkeletalAnimationModel<>&)>
+void BM_Synthetic(benchmark::State& state) {
+    stage(state, getSyntheticModel(state.range(0), state.range(1)));
+}
+
+//Runs the given stage on the AstroBoy model
+template<void (*stage)(benchmark::State&, const SkeletalAnimationModel<>&)>
+void BM_AstroBoy(benchmark::State& state) {
+    auto model=getAstroBoy();
+    if(!model) {
+        state.SkipWithError(("could not read "+modelPath+"astroBoy_walk_Maya.dae").c_str());
+        return;
+    }
+    stage(state, *model);
+}
+
+//Model::read import of the AstroBoy model files, including Assimp
+void BM_ReadAstroBoy(benchmark::State& state, const std::string& filename) {
+    for(auto _: state) {
+        SkeletalAnimationModel<> model;
+        model.read(modelPath+filename);
+        if(model.meshes.empty()) {
+            state.SkipWithError(("could not read "+modelPath+filename).c_str());
+            return;
+        }
+        benchmark::DoNotOptimize(model.meshes.data());
+    }
+}
+
+//Reading the AstroBoy model from a baked file, see SkeletalAnimationModel::writeBaked
+void BM_ReadBakedAstroBoy(benchmark::State& state) {
+    auto astroBoy=getAstroBoy();
+    if(!astroBoy) {
+        state.SkipWithError(("could not read "+modelPath+"astroBoy_walk_Maya.dae").c_str());
+        return;
+    }
+    const std::string filename="benchmarks_astroBoy.baked";
+    astroBoy->writeBaked(filename);
+    for(auto _: state) {
+        SkeletalAnimationModel<> model;
+        model.readBaked(filename);
+        benchmark::DoNotOptimize(model.meshes.data());
+    }
+    std::remove(filename.c_str());
+}
+
+//Synthetic rigs, with bones and vertices as arguments
+void syntheticRigs(benchmark::internal::Benchmark* benchmark) {
+    for(int numBones: {50, 200, 500}) {
+        for(int numVertices: {10000, 100000, 1000000})
+            benchmark->Args({numBones, numVertices});
+    }
+}
+void syntheticSkeletons(benchmark::internal::Benchmark* benchmark) {
+    for(int numBones: {50, 200, 500})
+        benchmark->Args({numBones, 10000});
+}
+
+BENCHMARK_TEMPLATE(BM_Synthetic, interpolate)->Apply(syntheticSkeletons);
+BENCHMARK_TEMPLATE(BM_Synthetic, createFrame)->Apply(syntheticSkeletons);
+BENCHMARK_TEMPLATE(BM_Synthetic, getMeshFrame)->Apply(syntheticRigs)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Synthetic, getMeshFrameAllocating)->Apply(syntheticRigs)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Synthetic, constructMeshFrame)->Apply(syntheticRigs)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_TEMPLATE(BM_AstroBoy, interpolate);
+BENCHMARK_TEMPLATE(BM_AstroBoy, createFrame);
+BENCHMARK_TEMPLATE(BM_AstroBoy, getMeshFrame)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_AstroBoy, getMeshFrameAllocating)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_AstroBoy, constructMeshFrame)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_CAPTURE(BM_ReadAstroBoy, Maya, std::string("astroBoy_walk_Maya.dae"))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ReadAstroBoy, Max, std::string("astroBoy_walk_Max.dae"))->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ReadBakedAstroBoy)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
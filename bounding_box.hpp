@@ -0,0 +1,96 @@
+#ifndef BOUNDING_BOX_HPP
+#define	BOUNDING_BOX_HPP
+
+#include <assimp/types.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//Axis-aligned bounding box, empty until a point is added.
+//See BoneWeights::boundingBox and SkeletalAnimationModel::getBoundingBox.
+class BoundingBox {
+public:
+    aiVector3D min;
+    aiVector3D max;
+
+    BoundingBox(): min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max()) {}
+
+    bool empty() const {
+        return min.x>max.x;
+    }
+
+    void add(const aiVector3D& point) {
+        min.x=std::min(min.x, point.x);
+        min.y=std::min(min.y, point.y);
+        min.z=std::min(min.z, point.z);
+        max.x=std::max(max.x, point.x);
+        max.y=std::max(max.y, point.y);
+        max.z=std::max(max.z, point.z);
+    }
+
+    void add(const BoundingBox& boundingBox) {
+        if(boundingBox.empty())
+            return;
+        add(boundingBox.min);
+        add(boundingBox.max);
+    }
+
+    //Returns the bounding box of this box transformed by the affine transformation, which contains the transformed box
+    BoundingBox transform(const aiMatrix4x4& transformation) const {
+        if(empty())
+            return *this;
+        aiVector3D center=(min+max)*0.5f;
+        aiVector3D extent=(max-min)*0.5f;
+        const aiMatrix4x4& t=transformation;
+        aiVector3D newCenter=t*center;
+        aiVector3D newExtent(std::fabs(t.a1)*extent.x+std::fabs(t.a2)*extent.y+std::fabs(t.a3)*extent.z,
+                             std::fabs(t.b1)*extent.x+std::fabs(t.b2)*extent.y+std::fabs(t.b3)*extent.z,
+                             std::fabs(t.c1)*extent.x+std::fabs(t.c2)*extent.y+std::fabs(t.c3)*extent.z);
+        BoundingBox boundingBox;
+        boundingBox.min=newCenter-newExtent;
+        boundingBox.max=newCenter+newExtent;
+        return boundingBox;
+    }
+};
+
+//View frustum for culling bounding boxes, as 6 planes where the points p with dot(normals[cp], p)+distances[cp]>=0 are inside plane cp
+class Frustum {
+public:
+    aiVector3D normals[6];
+    float distances[6];
+
+    //From a projection matrix, or a projection matrix multiplied with view and model matrices, to OpenGL clip coordinates.
+    //The boxes tested are then in the space before these transformations, for instance world space given a view projection matrix.
+    //The matrix transforms column vectors, as aiMatrix4x4 does, so an OpenGL matrix read with glGetFloatv must be transposed.
+    explicit Frustum(const aiMatrix4x4& matrix) {
+        const aiMatrix4x4& m=matrix;
+        //Left, right, bottom, top, near and far: the last row plus or minus the first three rows
+        float rows[3][4]={{m.a1, m.a2, m.a3, m.a4}, {m.b1, m.b2, m.b3, m.b4}, {m.c1, m.c2, m.c3, m.c4}};
+        for(unsigned int cp=0;cp<6;cp++) {
+            float sign=(cp%2==0) ? 1.0f : -1.0f;
+            const float* row=rows[cp/2];
+            normals[cp]=aiVector3D(m.d1+sign*row[0], m.d2+sign*row[1], m.d3+sign*row[2]);
+            distances[cp]=m.d4+sign*row[3];
+        }
+    }
+
+    //Returns false if boundingBox is entirely outside one of the planes, and then outside the frustum.
+    //Boxes outside the frustum near its edges may also return true.
+    bool intersects(const BoundingBox& boundingBox) const {
+        if(boundingBox.empty())
+            return false;
+        for(unsigned int cp=0;cp<6;cp++) {
+            //The corner of the box furthest along the plane normal
+            const aiVector3D& normal=normals[cp];
+            aiVector3D corner(normal.x>=0.0f ? boundingBox.max.x : boundingBox.min.x,
+                              normal.y>=0.0f ? boundingBox.max.y : boundingBox.min.y,
+                              normal.z>=0.0f ? boundingBox.max.z : boundingBox.min.z);
+            if(normal*corner+distances[cp]<0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif	/* BOUNDING_BOX_HPP */
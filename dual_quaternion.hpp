@@ -0,0 +1,122 @@
+#ifndef DUAL_QUATERNION_HPP
+#define	DUAL_QUATERNION_HPP
+
+#include "affine_transformation.hpp"
+
+#include <cmath>
+
+#if defined(SKELETAL_ANIMATION_MODEL_SSE)
+//Cross product of the x y z components, with w set to 0
+inline __m128 crossProduct(__m128 a, __m128 b) {
+    __m128 aYZX=_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX=_mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 zxy=_mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+    return _mm_shuffle_ps(zxy, zxy, _MM_SHUFFLE(3, 0, 2, 1));
+}
+#endif
+
+//Unit dual quaternion representing a rotation followed by a translation,
+//used instead of AffineTransformation when skinning with dual quaternions, see SkeletalAnimationModel::dualQuaternionSkinning.
+//Stored as 8 floats: the rotation quaternion x y z w followed by the dual part x y z w,
+//which is also the layout of the bone palette of skinBoneInfluencesDualQuaternion and the dual quaternion SkinningShader.
+class alignas(16) DualQuaternion {
+public:
+    float real[4];
+    float dual[4];
+
+    DualQuaternion() {
+        for(unsigned int c=0;c<4;c++) {
+            real[c]=(c==3) ? 1.0 : 0.0;
+            dual[c]=0.0;
+        }
+    }
+
+    //Scaling is not supported: the rotation is taken from the normalized columns of transformation
+    explicit DualQuaternion(const AffineTransformation& transformation) {
+        const float* columns=transformation.columns;
+        float scales[3];
+        for(unsigned int c=0;c<3;c++) {
+            scales[c]=std::sqrt(columns[c*4]*columns[c*4]+columns[c*4+1]*columns[c*4+1]+columns[c*4+2]*columns[c*4+2]);
+            if(scales[c]==0.0)
+                scales[c]=1.0;
+        }
+        //Rotation matrix element in row r, column c
+        auto m=[columns, &scales](unsigned int r, unsigned int c) {
+            return columns[c*4+r]/scales[c];
+        };
+
+        float trace=m(0, 0)+m(1, 1)+m(2, 2);
+        if(trace>0.0) {
+            float s=0.5f/std::sqrt(trace+1.0f);
+            real[0]=(m(2, 1)-m(1, 2))*s;
+            real[1]=(m(0, 2)-m(2, 0))*s;
+            real[2]=(m(1, 0)-m(0, 1))*s;
+            real[3]=0.25f/s;
+        }
+        else if(m(0, 0)>m(1, 1) && m(0, 0)>m(2, 2)) {
+            float s=2.0f*std::sqrt(1.0f+m(0, 0)-m(1, 1)-m(2, 2));
+            real[0]=0.25f*s;
+            real[1]=(m(0, 1)+m(1, 0))/s;
+            real[2]=(m(0, 2)+m(2, 0))/s;
+            real[3]=(m(2, 1)-m(1, 2))/s;
+        }
+        else if(m(1, 1)>m(2, 2)) {
+            float s=2.0f*std::sqrt(1.0f+m(1, 1)-m(0, 0)-m(2, 2));
+            real[0]=(m(0, 1)+m(1, 0))/s;
+            real[1]=0.25f*s;
+            real[2]=(m(1, 2)+m(2, 1))/s;
+            real[3]=(m(0, 2)-m(2, 0))/s;
+        }
+        else {
+            float s=2.0f*std::sqrt(1.0f+m(2, 2)-m(0, 0)-m(1, 1));
+            real[0]=(m(0, 2)+m(2, 0))/s;
+            real[1]=(m(1, 2)+m(2, 1))/s;
+            real[2]=0.25f*s;
+            real[3]=(m(1, 0)-m(0, 1))/s;
+        }
+
+        //dual=0.5*translation*real, with translation as a quaternion with w=0
+        const float* translation=columns+12;
+        dual[0]=0.5f*(translation[0]*real[3]+translation[1]*real[2]-translation[2]*real[1]);
+        dual[1]=0.5f*(translation[1]*real[3]+translation[2]*real[0]-translation[0]*real[2]);
+        dual[2]=0.5f*(translation[2]*real[3]+translation[0]*real[1]-translation[1]*real[0]);
+        dual[3]=-0.5f*(translation[0]*real[0]+translation[1]*real[1]+translation[2]*real[2]);
+    }
+
+    //Divides by the length of the rotation quaternion, for instance after blending dual quaternions.
+    //Returns false, leaving the dual quaternion unchanged, if the length is 0.
+    bool normalize() {
+        float lengthSquared=real[0]*real[0]+real[1]*real[1]+real[2]*real[2]+real[3]*real[3];
+        if(lengthSquared==0.0)
+            return false;
+        float inverseLength=1.0f/std::sqrt(lengthSquared);
+        for(unsigned int c=0;c<4;c++) {
+            real[c]*=inverseLength;
+            dual[c]*=inverseLength;
+        }
+        return true;
+    }
+
+    //The following functions assume a unit dual quaternion, for instance a normalized blend of bone dual quaternions
+
+    aiVector3D transformPoint(const aiVector3D& point) const {
+        aiVector3D rotated=transformNormal(point);
+        //translation=2*dual*conjugate(real)
+        return aiVector3D(rotated.x+2.0f*(real[3]*dual[0]-dual[3]*real[0]+real[1]*dual[2]-real[2]*dual[1]),
+                          rotated.y+2.0f*(real[3]*dual[1]-dual[3]*real[1]+real[2]*dual[0]-real[0]*dual[2]),
+                          rotated.z+2.0f*(real[3]*dual[2]-dual[3]*real[2]+real[0]*dual[1]-real[1]*dual[0]));
+    }
+
+    //Rotates normal
+    aiVector3D transformNormal(const aiVector3D& normal) const {
+        //normal+2*cross(real.xyz, cross(real.xyz, normal)+real.w*normal)
+        float x=real[1]*normal.z-real[2]*normal.y+real[3]*normal.x;
+        float y=real[2]*normal.x-real[0]*normal.z+real[3]*normal.y;
+        float z=real[0]*normal.y-real[1]*normal.x+real[3]*normal.z;
+        return aiVector3D(normal.x+2.0f*(real[1]*z-real[2]*y),
+                          normal.y+2.0f*(real[2]*x-real[0]*z),
+                          normal.z+2.0f*(real[0]*y-real[1]*x));
+    }
+};
+
+#endif	/* DUAL_QUATERNION_HPP */
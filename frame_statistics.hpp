@@ -0,0 +1,107 @@
+#ifndef FRAME_STATISTICS_HPP
+#define	FRAME_STATISTICS_HPP
+
+//Optional timers and counters of the stages of SkeletalAnimationModel: sampling animations,
+//updating the global bone transformations, skinning on the CPU and drawing.
+//Define SKELETAL_ANIMATION_MODEL_STATISTICS before including skeletal_animation_model.hpp to enable them,
+//and read them with FrameStatistics::global().getAndReset(), for instance once per frame.
+//Otherwise the SKELETAL_ANIMATION_MODEL_TIME and SKELETAL_ANIMATION_MODEL_COUNT macros expand to nothing.
+#ifdef SKELETAL_ANIMATION_MODEL_STATISTICS
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class FrameStatistics {
+public:
+    enum Stage {SAMPLING, BONE_TRANSFORMATIONS, SKINNING, DRAWING, NUM_STAGES};
+    enum Counter {KEYS_SCANNED, MATRICES_MULTIPLIED, VERTICES_SKINNED, BYTES_UPLOADED, MESHES_CULLED, NUM_COUNTERS};
+
+    //Copy of the statistics, for instance to pass on to telemetry
+    class Values {
+    public:
+        //Time spent in each stage, summed over all threads
+        uint64_t nanoseconds[NUM_STAGES]={};
+        uint64_t calls[NUM_STAGES]={};
+        uint64_t counters[NUM_COUNTERS]={};
+    };
+
+private:
+    std::atomic<uint64_t> nanoseconds[NUM_STAGES];
+    std::atomic<uint64_t> calls[NUM_STAGES];
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+
+public:
+    FrameStatistics() {
+        reset();
+    }
+
+    FrameStatistics(const FrameStatistics&)=delete;
+    FrameStatistics& operator=(const FrameStatistics&)=delete;
+
+    //The statistics of all the models, updated from any thread
+    static FrameStatistics& global() {
+        static FrameStatistics frameStatistics;
+        return frameStatistics;
+    }
+
+    void addTime(Stage stage, uint64_t stageNanoseconds) {
+        nanoseconds[stage].fetch_add(stageNanoseconds, std::memory_order_relaxed);
+        calls[stage].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void add(Counter counter, uint64_t value) {
+        counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    Values get() const {
+        Values values;
+        for(unsigned int cs=0;cs<NUM_STAGES;cs++) {
+            values.nanoseconds[cs]=nanoseconds[cs].load(std::memory_order_relaxed);
+            values.calls[cs]=calls[cs].load(std::memory_order_relaxed);
+        }
+        for(unsigned int cc=0;cc<NUM_COUNTERS;cc++)
+            values.counters[cc]=counters[cc].load(std::memory_order_relaxed);
+        return values;
+    }
+
+    //Returns the statistics since the previous reset, and starts over
+    Values getAndReset() {
+        Values values;
+        for(unsigned int cs=0;cs<NUM_STAGES;cs++) {
+            values.nanoseconds[cs]=nanoseconds[cs].exchange(0, std::memory_order_relaxed);
+            values.calls[cs]=calls[cs].exchange(0, std::memory_order_relaxed);
+        }
+        for(unsigned int cc=0;cc<NUM_COUNTERS;cc++)
+            values.counters[cc]=counters[cc].exchange(0, std::memory_order_relaxed);
+        return values;
+    }
+
+    void reset() {
+        getAndReset();
+    }
+
+    //Adds the time from construction to destruction to the given stage of FrameStatistics::global()
+    class Timer {
+        Stage stage;
+        std::chrono::steady_clock::time_point start;
+    public:
+        Timer(Stage stage): stage(stage), start(std::chrono::steady_clock::now()) {}
+
+        ~Timer() {
+            global().addTime(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count());
+        }
+    };
+};
+
+#define SKELETAL_ANIMATION_MODEL_TIME(stage) FrameStatistics::Timer frameStatisticsTimer(FrameStatistics::stage)
+#define SKELETAL_ANIMATION_MODEL_COUNT(counter, value) FrameStatistics::global().add(FrameStatistics::counter, value)
+
+#else
+
+#define SKELETAL_ANIMATION_MODEL_TIME(stage)
+#define SKELETAL_ANIMATION_MODEL_COUNT(counter, value)
+
+#endif
+
+#endif	/* FRAME_STATISTICS_HPP */
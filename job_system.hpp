@@ -0,0 +1,325 @@
+#ifndef JOB_SYSTEM_HPP
+#define	JOB_SYSTEM_HPP
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//Thread pool with one job queue per worker thread, where idle workers steal jobs from the other queues.
+//Jobs may run new jobs, for instance one job per mesh after the animation frame of a model is created.
+//Used by SkeletalAnimationModel::createFrames
+class JobSystem {
+public:
+    //Counts the unfinished jobs run with the counter, see run and wait.
+    //Also holds the first exception thrown by these jobs, which is rethrown by wait.
+    class Counter {
+        friend class JobSystem;
+        std::atomic<unsigned int> count;
+        std::mutex exceptionMutex;
+        std::exception_ptr exception;
+    public:
+        Counter(): count(0) {}
+    };
+
+private:
+    //A job function stored inside the job, so that queuing the small jobs of for instance SkeletalAnimationModel::createFrames
+    //does not allocate every frame. Functions larger than inlineSize are stored in a std::function instead.
+    class Job {
+        static const size_t inlineSize=6*sizeof(void*);
+        typename std::aligned_storage<inlineSize, alignof(std::max_align_t)>::type storage;
+        //Calls, and moves or destroys, the function in storage
+        void (*invoke)(void* function)=nullptr;
+        void (*move)(void* from, void* to)=nullptr;
+        void (*destroy)(void* function)=nullptr;
+
+        template<class Function>
+        void create(Function&& function) {
+            typedef typename std::decay<Function>::type FunctionType;
+            new(&storage) FunctionType(std::forward<Function>(function));
+            invoke=[](void* function) {
+                (*static_cast<FunctionType*>(function))();
+            };
+            move=[](void* from, void* to) {
+                new(to) FunctionType(std::move(*static_cast<FunctionType*>(from)));
+            };
+            destroy=[](void* function) {
+                static_cast<FunctionType*>(function)->~FunctionType();
+            };
+        }
+
+    public:
+        Counter* counter=nullptr;
+
+        Job() {}
+
+        template<class Function, typename std::enable_if<sizeof(typename std::decay<Function>::type)<=inlineSize && 
+                 std::is_nothrow_move_constructible<typename std::decay<Function>::type>::value, int>::type=0>
+        Job(Function&& function, Counter* counter): counter(counter) {
+            create(std::forward<Function>(function));
+        }
+
+        template<class Function, typename std::enable_if<!(sizeof(typename std::decay<Function>::type)<=inlineSize && 
+                 std::is_nothrow_move_constructible<typename std::decay<Function>::type>::value), int>::type=0>
+        Job(Function&& function, Counter* counter): counter(counter) {
+            create(std::function<void()>(std::forward<Function>(function)));
+        }
+
+        Job(Job&& job) noexcept: invoke(job.invoke), move(job.move), destroy(job.destroy), counter(job.counter) {
+            if(invoke)
+                move(&job.storage, &storage);
+        }
+
+        Job& operator=(Job&& job) noexcept {
+            if(this!=&job) {
+                this->~Job();
+                new(this) Job(std::move(job));
+            }
+            return *this;
+        }
+
+        ~Job() {
+            if(invoke)
+                destroy(&storage);
+        }
+
+        void operator()() {
+            invoke(&storage);
+        }
+    };
+
+    //Ring buffer of jobs, where the newest job is popped by the worker thread and the oldest job is stolen by the other threads.
+    //Only grows, so that queuing jobs every frame does not allocate.
+    class Queue {
+        std::vector<Job> jobs;
+        size_t first=0;
+        size_t numJobs=0;
+
+    public:
+        std::mutex mutex;
+
+        bool empty() const {
+            return numJobs==0;
+        }
+
+        void push(Job&& job) {
+            if(numJobs==jobs.size()) {
+                std::vector<Job> newJobs(std::max<size_t>(2*jobs.size(), 16));
+                for(size_t c=0;c<numJobs;c++)
+                    newJobs[c]=std::move(jobs[(first+c)%jobs.size()]);
+                jobs.swap(newJobs);
+                first=0;
+            }
+            jobs[(first+numJobs)%jobs.size()]=std::move(job);
+            numJobs++;
+        }
+
+        void popNewest(Job& job) {
+            numJobs--;
+            auto& newest=jobs[(first+numJobs)%jobs.size()];
+            job=std::move(newest);
+            newest=Job();
+        }
+
+        void popOldest(Job& job) {
+            job=std::move(jobs[first]);
+            jobs[first]=Job();
+            first=(first+1)%jobs.size();
+            numJobs--;
+        }
+
+        //Pops the newest job run with the given counter, moving the newer jobs back. Returns false if there is none.
+        bool popNewest(Job& job, const Counter* counter) {
+            for(size_t c=numJobs;c>0;c--) {
+                if(jobs[(first+c-1)%jobs.size()].counter!=counter)
+                    continue;
+                job=std::move(jobs[(first+c-1)%jobs.size()]);
+                for(;c<numJobs;c++)
+                    jobs[(first+c-1)%jobs.size()]=std::move(jobs[(first+c)%jobs.size()]);
+                numJobs--;
+                jobs[(first+numJobs)%jobs.size()]=Job();
+                return true;
+            }
+            return false;
+        }
+    };
+
+    //One queue per worker thread, and a last queue for jobs run from other threads
+    std::vector<std::unique_ptr<Queue> > queues;
+    std::vector<std::thread> threads;
+
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<unsigned int> numQueuedJobs;
+    bool stop;
+
+    //Counts the jobs run without a counter
+    Counter backgroundJobs;
+
+    //The JobSystem and queue id of the current thread, if it is a worker thread
+    static std::pair<const JobSystem*, unsigned int>& currentWorker() {
+        static thread_local std::pair<const JobSystem*, unsigned int> worker(nullptr, 0);
+        return worker;
+    }
+
+    unsigned int currentQueueId() const {
+        auto& worker=currentWorker();
+        if(worker.first==this)
+            return worker.second;
+        return queues.size()-1;
+    }
+
+    //Pop the newest job from the given queue, or else steal the oldest job from one of the other queues.
+    //If counter is given, only jobs run with this counter are popped, from the newest in each queue.
+    bool popJob(unsigned int queueId, Job& job, const Counter* counter=nullptr) {
+        for(unsigned int c=0;c<queues.size();c++) {
+            auto& queue=*queues[(queueId+c)%queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(queue.empty())
+                continue;
+            if(counter) {
+                if(!queue.popNewest(job, counter))
+                    continue;
+            }
+            else if(c==0)
+                queue.popNewest(job);
+            else
+                queue.popOldest(job);
+            numQueuedJobs--;
+            return true;
+        }
+        return false;
+    }
+
+    //Decrements the counter of the job when the job returns or throws
+    class CounterGuard {
+        Counter& counter;
+    public:
+        CounterGuard(Counter& counter): counter(counter) {}
+        ~CounterGuard() {
+            counter.count.fetch_sub(1, std::memory_order_release);
+        }
+    };
+
+    //Runs the job, and stores the exception it throws in its counter if it is the first one, see wait
+    void execute(Job& job) {
+        CounterGuard guard(*job.counter);
+        try {
+            job();
+        }
+        catch(...) {
+            std::lock_guard<std::mutex> lock(job.counter->exceptionMutex);
+            if(!job.counter->exception)
+                job.counter->exception=std::current_exception();
+        }
+    }
+
+    void workerLoop(unsigned int queueId) {
+        currentWorker()=std::make_pair(this, queueId);
+        while(true) {
+            Job job;
+            if(popJob(queueId, job)) {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCondition.wait(lock, [this] {
+                return stop || numQueuedJobs>0;
+            });
+            //The queued jobs are run before stopping, see ~JobSystem
+            if(stop && numQueuedJobs==0)
+                return;
+        }
+    }
+
+public:
+    //numThreads worker threads, in addition to the threads calling wait.
+    //The destructor returns when the worker threads have run all the queued jobs, including the jobs queued by these jobs.
+    JobSystem(unsigned int numThreads=std::max(std::thread::hardware_concurrency(), 2u)-1): numQueuedJobs(0), stop(false) {
+        for(unsigned int c=0;c<numThreads+1;c++)
+            queues.emplace_back(new Queue());
+        for(unsigned int c=0;c<numThreads;c++)
+            threads.emplace_back(&JobSystem::workerLoop, this, c);
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stop=true;
+        }
+        sleepCondition.notify_all();
+        for(auto& thread: threads)
+            thread.join();
+    }
+
+    JobSystem(const JobSystem&)=delete;
+    JobSystem& operator=(const JobSystem&)=delete;
+
+    unsigned int numThreads() const {
+        return threads.size();
+    }
+
+    //Queues the given job function, which is called without arguments. Can be called from any thread, including from within a job.
+    template<class Function>
+    void run(Counter& counter, Function&& function) {
+        counter.count.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            numQueuedJobs++;
+        }
+        auto& queue=*queues[currentQueueId()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.push(Job(std::forward<Function>(function), &counter));
+        }
+        sleepCondition.notify_one();
+    }
+
+    //Queues the given job without a counter, for instance a job reading a model in the background, see Model::readAsync.
+    //Only run by the worker threads, never by wait, so a long job does not stall a thread waiting for its frame jobs.
+    //Without worker threads, the job is instead run before run returns. Exceptions thrown by the job are discarded.
+    template<class Function>
+    void run(Function&& function) {
+        if(threads.empty()) {
+            try {
+                function();
+            }
+            catch(...) {}
+            return;
+        }
+        run(backgroundJobs, std::forward<Function>(function));
+    }
+
+    //Returns when all the jobs run with the given counter, and the jobs they run with it, are finished.
+    //The calling thread executes the queued jobs of this counter while waiting, but no other jobs.
+    //Then rethrows the first exception thrown by these jobs, if any, and resets it so that the counter can be reused.
+    void wait(Counter& counter) {
+        unsigned int queueId=currentQueueId();
+        while(counter.count.load(std::memory_order_acquire)>0) {
+            Job job;
+            if(popJob(queueId, job, &counter))
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(counter.exceptionMutex);
+            std::swap(exception, counter.exception);
+        }
+        if(exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+#endif	/* JOB_SYSTEM_HPP */
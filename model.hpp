@@ -6,12 +6,67 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <vector>
+#include <algorithm>
+#include <memory>
+#include <cstddef>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <future>
+#include <exception>
 
-//For the draw functions:
-#ifdef __APPLE__
+#include "baked_file.hpp"
+#include "job_system.hpp"
+#include "arena.hpp"
+
+//For the draw functions. Define SKELETAL_ANIMATION_MODEL_NO_GL before including to leave out OpenGL,
+//and the functions that draw or upload, for instance on a server or in an asset pipeline tool.
+//The vertex buffer objects, GPU skinning, instancing, transform feedback and compact vertices need the OpenGL 3.1 declarations, 
+//which only the Linux headers provide and link directly. Elsewhere, for instance with opengl32 on Windows or on macOS, include an OpenGL loader 
+//such as GLEW or glad before this header. SKELETAL_ANIMATION_MODEL_GL_3_1 is defined if they are declared, and otherwise only 
+//the OpenGL 1.1 draw functions are compiled. Define SKELETAL_ANIMATION_MODEL_GL_1_1 before including to leave out the OpenGL 3.1 paths anyway.
+#ifndef SKELETAL_ANIMATION_MODEL_NO_GL
+#if defined(GL_VERSION_3_1)
+//Declared by a loader included before this header
+#elif defined(__APPLE__)
 #include <OpenGL/gl.h>
+#elif defined(_WIN32)
+#include <GL/gl.h>
 #else
+#define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+#if defined(GL_VERSION_3_1) && !defined(SKELETAL_ANIMATION_MODEL_GL_1_1)
+#define SKELETAL_ANIMATION_MODEL_GL_3_1
+#endif
+#endif
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+//OpenGL buffer object (requires OpenGL 1.5).
+//Copies of a GLBuffer share the same buffer object, which is deleted when the last copy is destroyed.
+class GLBuffer {
+    std::shared_ptr<GLuint> buffer;
+public:
+    GLuint id() const {return buffer?*buffer:0;}
+    explicit operator bool() const {return static_cast<bool>(buffer);}
+
+    //Creates the buffer object and uploads data to it. Requires a current OpenGL context.
+    template<class T, class Allocator>
+    void create(GLenum target, const std::vector<T, Allocator>& data, GLenum usage=GL_STATIC_DRAW) {
+        buffer=std::shared_ptr<GLuint>(new GLuint(0), [](GLuint* id) {
+            glDeleteBuffers(1, id);
+            delete id;
+        });
+        glGenBuffers(1, buffer.get());
+        glBindBuffer(target, *buffer);
+        glBufferData(target, data.size()*sizeof(T), data.data(), usage);
+        glBindBuffer(target, 0);
+    }
+};
 #endif
 
 //Defines how to write a new Material class for Model and SkeletalAnimationModel.
@@ -20,34 +75,194 @@
 class Material {
 public:
     Material() {}
+    //Called on a worker thread when the model is read with Model::readAsync, and should then not use OpenGL
     Material(const aiMaterial* material) {}
+    //Creates the OpenGL objects of the material, for instance its textures, on the OpenGL thread, see Model::upload.
+    //Optional: materials without upload are expected to create them in the constructor.
+    virtual void upload() {}
     virtual void bindTexture(aiTextureType textureType, unsigned int textureId) const {}
     virtual bool texture() const {return false;}
 };
 
-class Mesh {
+//Converts value to a half precision float, see GL_HALF_FLOAT
+inline uint16_t packHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign=(bits>>16)&0x8000;
+    int exponent=static_cast<int>((bits>>23)&0xff)-127+15;
+    uint32_t mantissa=bits&0x7fffff;
+    if(exponent>=31) //Infinity, NaN or too large
+        return sign|0x7c00|(((bits>>23)&0xff)==0xff && mantissa ? 0x200 : 0);
+    if(exponent<=0) { //Subnormal or zero
+        if(exponent<-10)
+            return sign;
+        mantissa|=0x800000;
+        unsigned int shift=14-exponent;
+        return sign|((mantissa>>shift)+((mantissa>>(shift-1))&1));
+    }
+    //Rounding may carry into the exponent, which gives the correctly rounded value
+    return (sign|(exponent<<10)|(mantissa>>13))+((mantissa>>12)&1);
+}
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+//Converts a unit vector to signed normalized bytes, padded to 4 bytes, see GL_BYTE normal arrays
+inline void packNormal(const aiVector3D& normal, GLbyte* packedNormal) {
+    for(unsigned int c=0;c<3;c++)
+        packedNormal[c]=std::round(std::max(-1.0f, std::min(normal[c], 1.0f))*127.0f);
+    packedNormal[3]=0;
+}
+
+//Layout of the interleaved vertices in a vertex buffer, see Model::compactVertices.
+//Positions are floats. Normals are floats, or 4 signed normalized bytes in compact vertices.
+//Texture coordinates are floats, or half floats in compact vertices, and left out of meshes without texture coordinates.
+//The bone influences used when skinning on the GPU are 4 float bone ids and 4 float weights,
+//or 4 unsigned byte bone ids and 4 normalized unsigned short weights in compact vertices.
+class VertexFormat {
 public:
-    std::vector<aiVector3D> vertices;
-    std::vector<aiVector3D> normals;
-    std::vector<aiVector2D> textureCoords;
+    bool compact=false;
+    bool textureCoords=false;
+    bool boneInfluences=false;
+
+    //Offsets in bytes within a vertex
+    size_t normalOffset=0;
+    size_t textureCoordOffset=0;
+    size_t boneIdsOffset=0;
+    size_t boneWeightsOffset=0;
+    //Size of a vertex in bytes, which is also the stride of the buffer
+    size_t size=0;
 
-    std::vector<aiFace> faces;
+    VertexFormat() {}
+
+    VertexFormat(bool compact, bool textureCoords, bool boneInfluences=false): 
+            compact(compact), textureCoords(textureCoords), boneInfluences(boneInfluences) {
+        normalOffset=3*sizeof(GLfloat);
+        textureCoordOffset=normalOffset+(compact ? 4*sizeof(GLbyte) : 3*sizeof(GLfloat));
+        boneIdsOffset=textureCoordOffset+(textureCoords ? (compact ? 2*sizeof(uint16_t) : 2*sizeof(GLfloat)) : 0);
+        boneWeightsOffset=boneIdsOffset+(boneInfluences ? (compact ? 4*sizeof(GLubyte) : 4*sizeof(GLfloat)) : 0);
+        size=boneWeightsOffset+(boneInfluences ? (compact ? 4*sizeof(GLushort) : 4*sizeof(GLfloat)) : 0);
+    }
+
+    //Enables the vertex, normal and, if texture is true and the vertices have texture coordinates, 
+    //texture coordinate arrays of the bound array buffer
+    void enableArrays(bool texture) const {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, size, nullptr);
+        glNormalPointer(compact ? GL_BYTE : GL_FLOAT, size, reinterpret_cast<const GLvoid*>(normalOffset));
+        if(texture && textureCoords) {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, compact ? GL_HALF_FLOAT : GL_FLOAT, size, reinterpret_cast<const GLvoid*>(textureCoordOffset));
+        }
+    }
+
+    void disableArrays(bool texture) const {
+        if(texture && textureCoords)
+            glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    }
+};
+#endif
+
+//std::vector of T allocated with Allocator rebound to T. A plain std::vector for the default std::allocator.
+template<class T, class Allocator>
+using AllocatorVector=std::vector<T, typename std::allocator_traits<Allocator>::template rebind_alloc<T> >;
+
+//Resizes values, creating the new elements with the allocator of values, 
+//so that for instance the vectors of new meshes are allocated from the same arena as the vector of meshes
+template<class T, class Allocator>
+void resizeWithAllocator(std::vector<T, Allocator>& values, size_t size) {
+    if(size<values.size()) {
+        values.erase(values.begin()+size, values.end());
+        return;
+    }
+    values.reserve(size);
+    while(values.size()<size)
+        values.emplace_back(values.get_allocator());
+}
+
+//The vectors of a mesh are allocated with Allocator, for instance ArenaAllocator so that the static data of a model 
+//lives in one Arena, see ArenaMesh. Mesh uses std::allocator.
+template<class Allocator=std::allocator<char> >
+class BasicMesh {
+public:
+    typedef Allocator allocator_type;
+
+    AllocatorVector<aiVector3D, Allocator> vertices;
+    AllocatorVector<aiVector3D, Allocator> normals;
+    //Empty if the mesh has no texture coordinates
+    AllocatorVector<aiVector2D, Allocator> textureCoords;
+
+    //The triangles, 3 vertex indices each
+    AllocatorVector<unsigned int, Allocator> indices;
 
     //In AssImp: one material per mesh
     unsigned int materialId;
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //Interleaved vertices, normals and texture coordinates, and the indices, see Model::vertexBufferObjects
+    GLBuffer vertexBuffer;
+    GLBuffer indexBuffer;
+    unsigned int numIndices=0;
+    VertexFormat vertexFormat;
+#endif
+
+    explicit BasicMesh(const Allocator& allocator=Allocator()): 
+            vertices(allocator), normals(allocator), textureCoords(allocator), indices(allocator) {}
 };
 
+typedef BasicMesh<> Mesh;
+typedef BasicMesh<ArenaAllocator<char> > ArenaMesh;
+
 template<class MaterialType=Material, class MeshType=Mesh>
 class Model {
+    //Calls material.upload() if MaterialType has it, see Material::upload
+    template<class T>
+    static auto uploadMaterial(T& material, int) -> decltype(material.upload(), void()) {
+        material.upload();
+    }
+    template<class T>
+    static void uploadMaterial(T& material, long) {}
+
 public:
-    std::vector<MeshType> meshes;
+    //See BasicMesh
+    typedef typename MeshType::allocator_type allocator_type;
+
+    AllocatorVector<MeshType, allocator_type> meshes;
     std::vector<MaterialType> materials;
 
+    //Diffuse texture paths of each material, stored by read so that writeBaked can recreate the materials.
+    //Other material properties are not stored in baked files.
+    std::vector<std::vector<std::string> > materialDiffuseTextures;
+
+    //Set to true before calling read to store the meshes in vertex buffer objects.
+    //drawMesh then binds the buffers and issues a single draw call per mesh, 
+    //instead of sending every vertex each time.
+    //Requires OpenGL 1.5 and a current OpenGL context when read or upload is called. Ignored without SKELETAL_ANIMATION_MODEL_GL_3_1.
+    bool vertexBufferObjects=false;
+
+    //Set to true, in addition to vertexBufferObjects or SkeletalAnimationModel::gpuSkinning, before calling read 
+    //to store the vertex buffers in compact formats, about half the size, see VertexFormat. Requires OpenGL 3.0.
+    bool compactVertices=false;
+
+    //Set to true before calling read to reorder the triangles and vertices of each mesh for the vertex caches, see optimizeMesh.
+    //The vertices are then no longer in the same order as in the model file.
+    bool optimizeMeshes=false;
+
+    //Set to false before calling read or readBaked to read neither the materials nor the meshes, 
+    //for instance to evaluate only the bones and animations of a SkeletalAnimationModel on a server
+    bool readMeshes=true;
+
+    //The meshes and their vectors are allocated with allocator, for instance from an arena: 
+    //Arena arena; Model<Material, ArenaMesh> model(arena);
+    explicit Model(const allocator_type& allocator=allocator_type()): meshes(allocator) {}
+
+#ifndef SKELETAL_ANIMATION_MODEL_NO_GL
     //Draws the given mesh.
     //Currently only supports 1 diffuse texture per material
     virtual void drawMesh(const MeshType& mesh) const {
         bool texture=false;
-        if(this->materials[mesh.materialId].texture())
+        if(this->materials[mesh.materialId].texture() && !mesh.textureCoords.empty())
             texture=true;
 
         //If material has texture, use only the first one (assumes one diffuse texture per material).
@@ -56,22 +271,29 @@ public:
             this->materials[mesh.materialId].bindTexture(aiTextureType_DIFFUSE, 0);
         }
 
-        glBegin(GL_TRIANGLES);
-        for(auto& face: mesh.faces) {
-            glNormal3f(mesh.normals[face.mIndices[0]].x, mesh.normals[face.mIndices[0]].y, mesh.normals[face.mIndices[0]].z);
-            if(texture)
-                glTexCoord2f(mesh.textureCoords[face.mIndices[0]].x, mesh.textureCoords[face.mIndices[0]].y);
-            glVertex3f(mesh.vertices[face.mIndices[0]].x, mesh.vertices[face.mIndices[0]].y, mesh.vertices[face.mIndices[0]].z);
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+        if(mesh.vertexBuffer) {
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer.id());
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer.id());
 
-            glNormal3f(mesh.normals[face.mIndices[1]].x, mesh.normals[face.mIndices[1]].y, mesh.normals[face.mIndices[1]].z);
-            if(texture)
-                glTexCoord2f(mesh.textureCoords[face.mIndices[1]].x, mesh.textureCoords[face.mIndices[1]].y);                    
-            glVertex3f(mesh.vertices[face.mIndices[1]].x, mesh.vertices[face.mIndices[1]].y, mesh.vertices[face.mIndices[1]].z);
+            mesh.vertexFormat.enableArrays(texture);
+
+            glDrawElements(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT, nullptr);
 
-            glNormal3f(mesh.normals[face.mIndices[2]].x, mesh.normals[face.mIndices[2]].y, mesh.normals[face.mIndices[2]].z);
+            mesh.vertexFormat.disableArrays(texture);
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return;
+        }
+#endif
+
+        glBegin(GL_TRIANGLES);
+        for(auto index: mesh.indices) {
+            glNormal3f(mesh.normals[index].x, mesh.normals[index].y, mesh.normals[index].z);
             if(texture)
-                glTexCoord2f(mesh.textureCoords[face.mIndices[2]].x, mesh.textureCoords[face.mIndices[2]].y);
-            glVertex3f(mesh.vertices[face.mIndices[2]].x, mesh.vertices[face.mIndices[2]].y, mesh.vertices[face.mIndices[2]].z);
+                glTexCoord2f(mesh.textureCoords[index].x, mesh.textureCoords[index].y);
+            glVertex3f(mesh.vertices[index].x, mesh.vertices[index].y, mesh.vertices[index].z);
         }
         glEnd();
     }
@@ -82,48 +304,407 @@ public:
             drawMesh(mesh);
         }
     }
+#endif
 
     virtual void read(const std::string& filename, unsigned int assimpImporterFlags=aiProcessPreset_TargetRealtime_Fast) {
         Assimp::Importer importer;
 
         const aiScene *scene = importer.ReadFile(filename, assimpImporterFlags);
         
-        if(scene)
-            read(scene);
+        if(scene) {
+            readScene(scene, nullptr);
+            upload();
+        }
+    }
+
+    //Reads the model on the worker threads of jobSystem, with one job per material and one job per mesh, 
+    //and returns a future that is ready when the model is read, except for its OpenGL objects.
+    //If jobSystem has no worker threads, the model is read before readAsync returns.
+    //Then call upload on the OpenGL thread before drawing the model, see Material::upload.
+    //The model must not be used until then. Exceptions thrown while reading are stored in the future.
+    std::future<void> readAsync(const std::string& filename, JobSystem& jobSystem, unsigned int assimpImporterFlags=aiProcessPreset_TargetRealtime_Fast) {
+        auto promise=std::make_shared<std::promise<void> >();
+        auto future=promise->get_future();
+        jobSystem.run([this, filename, assimpImporterFlags, &jobSystem, promise] {
+            try {
+                Assimp::Importer importer;
+
+                const aiScene *scene = importer.ReadFile(filename, assimpImporterFlags);
+
+                if(scene)
+                    readScene(scene, &jobSystem);
+                promise->set_value();
+            }
+            catch(...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        return future;
+    }
+
+    //Creates the OpenGL objects of the model: the textures of the materials, and the vertex buffer objects if vertexBufferObjects is set.
+    //Called by read and readBaked, and once after readAsync. Requires a current OpenGL context.
+    virtual void upload() {
+        for(auto& material: materials)
+            uploadMaterial(material, 0);
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+        if(vertexBufferObjects) {
+            for(auto& mesh: meshes)
+                createBuffers(mesh);
+        }
+#endif
+    }
+
+    //Writes the model to a binary file that readBaked can read much faster than read, without Assimp. 
+    //Typically written once after read, see baked_file.hpp.
+    virtual void writeBaked(const std::string& filename) const {
+        BakedWriter writer(filename);
+        writeBaked(writer);
+        writer.close();
+    }
+
+    //Reads a model written by writeBaked. The file is memory mapped, and each array is copied with one memcpy.
+    //Returns false if the file could not be opened, and throws std::runtime_error if the file is invalid.
+    virtual bool readBaked(const std::string& filename) {
+        MappedFile file;
+        if(!file.open(filename))
+            return false;
+
+        BakedReader reader(file.data(), file.size());
+        readBaked(reader);
+        if(!readMeshes)
+            meshes.clear();
+        upload();
+        return true;
     }
 
 protected:
+    //Runs function(index) for each index in [0, size), as parallel jobs if jobSystem is given
+    template<class Function>
+    static void runJobs(JobSystem* jobSystem, size_t size, const Function& function) {
+        if(!jobSystem) {
+            for(size_t c=0;c<size;c++)
+                function(c);
+            return;
+        }
+        JobSystem::Counter counter;
+        for(size_t c=0;c<size;c++) {
+            jobSystem->run(counter, [&function, c] {
+                function(c);
+            });
+        }
+        jobSystem->wait(counter);
+    }
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //Upload the indices of the given mesh
+    void createIndexBuffer(MeshType& mesh) {
+        mesh.indexBuffer.create(GL_ELEMENT_ARRAY_BUFFER, mesh.indices);
+        mesh.numIndices=mesh.indices.size();
+    }
+
+#endif
+
+    //Reorders the triangles of the given mesh for the post-transform vertex cache using Tom Forsyth's 
+    //linear-speed vertex cache optimisation, and then the vertices in the order they are first used by the triangles, 
+    //so that the vertices are mostly read sequentially when drawing. Returns the new vertex id of each previous vertex id.
+    virtual std::vector<unsigned int> optimizeMesh(MeshType& mesh) {
+        const unsigned int cacheSize=32;
+        size_t numTriangles=mesh.indices.size()/3;
+        size_t numVertices=mesh.vertices.size();
+
+        auto vertexScore=[cacheSize](int cachePosition, unsigned int numTriangles) -> float {
+            if(numTriangles==0)
+                return -1.0;
+            float score=0.0;
+            //The vertices of the last triangle get a fixed score, so that the next triangle does not depend on their order
+            if(cachePosition>=0 && cachePosition<3)
+                score=0.75;
+            else if(cachePosition>=3)
+                score=std::pow(1.0f-(cachePosition-3)/static_cast<float>(cacheSize-3), 1.5f);
+            //Prefer vertices with few remaining triangles, to avoid leaving lone triangles behind
+            return score+2.0f/std::sqrt(static_cast<float>(numTriangles));
+        };
+
+        //The remaining triangles of vertex cv are vertexTriangles[vertexTriangleOffsets[cv]] and the numRemaining[cv]-1 following
+        std::vector<unsigned int> numRemaining(numVertices, 0);
+        for(auto index: mesh.indices)
+            numRemaining[index]++;
+        std::vector<unsigned int> vertexTriangleOffsets(numVertices+1, 0);
+        std::partial_sum(numRemaining.begin(), numRemaining.end(), vertexTriangleOffsets.begin()+1);
+        std::vector<unsigned int> vertexTriangles(numTriangles*3);
+        std::vector<unsigned int> numAdded(numVertices, 0);
+        for(unsigned int ct=0;ct<numTriangles;ct++) {
+            for(unsigned int c=0;c<3;c++) {
+                unsigned int vertex=mesh.indices[ct*3+c];
+                vertexTriangles[vertexTriangleOffsets[vertex]+numAdded[vertex]++]=ct;
+            }
+        }
+
+        std::vector<int> cachePositions(numVertices, -1);
+        std::vector<float> vertexScores(numVertices);
+        for(unsigned int cv=0;cv<numVertices;cv++)
+            vertexScores[cv]=vertexScore(-1, numRemaining[cv]);
+        std::vector<float> triangleScores(numTriangles);
+        for(unsigned int ct=0;ct<numTriangles;ct++)
+            triangleScores[ct]=vertexScores[mesh.indices[ct*3]]+vertexScores[mesh.indices[ct*3+1]]+vertexScores[mesh.indices[ct*3+2]];
+
+        std::vector<bool> triangleAdded(numTriangles, false);
+        //The new arrays of the mesh use its allocator
+        decltype(mesh.indices) indices(mesh.indices.get_allocator());
+        indices.reserve(numTriangles*3);
+        std::vector<unsigned int> cache, newCache;
+        size_t nextTriangle=0;
+        long bestTriangle=-1;
+        for(size_t cc=0;cc<numTriangles;cc++) {
+            //If no triangle of the cached vertices remains, continue with the next triangle in the original order
+            if(bestTriangle<0) {
+                while(triangleAdded[nextTriangle])
+                    nextTriangle++;
+                bestTriangle=nextTriangle;
+            }
+            unsigned int triangle=bestTriangle;
+            triangleAdded[triangle]=true;
+
+            //The vertices of the triangle are moved to the front of the cache
+            newCache.clear();
+            for(unsigned int c=0;c<3;c++) {
+                unsigned int vertex=mesh.indices[triangle*3+c];
+                indices.emplace_back(vertex);
+                unsigned int* triangles=&vertexTriangles[vertexTriangleOffsets[vertex]];
+                std::swap(*std::find(triangles, triangles+numRemaining[vertex], triangle), triangles[numRemaining[vertex]-1]);
+                numRemaining[vertex]--;
+                if(std::find(newCache.begin(), newCache.end(), vertex)==newCache.end())
+                    newCache.emplace_back(vertex);
+            }
+            size_t numTriangleVertices=newCache.size();
+            for(auto vertex: cache) {
+                if(std::find(newCache.begin(), newCache.begin()+numTriangleVertices, vertex)==newCache.begin()+numTriangleVertices)
+                    newCache.emplace_back(vertex);
+            }
+
+            //Update the scores of the cached vertices, including the vertices leaving the cache, and of their remaining triangles
+            for(unsigned int cv=0;cv<newCache.size();cv++) {
+                unsigned int vertex=newCache[cv];
+                cachePositions[vertex]=cv<cacheSize ? static_cast<int>(cv) : -1;
+                float score=vertexScore(cachePositions[vertex], numRemaining[vertex]);
+                float scoreChange=score-vertexScores[vertex];
+                vertexScores[vertex]=score;
+                for(unsigned int ct=0;ct<numRemaining[vertex];ct++)
+                    triangleScores[vertexTriangles[vertexTriangleOffsets[vertex]+ct]]+=scoreChange;
+            }
+            if(newCache.size()>cacheSize)
+                newCache.resize(cacheSize);
+            std::swap(cache, newCache);
+
+            bestTriangle=-1;
+            float bestScore=-std::numeric_limits<float>::max();
+            for(auto vertex: cache) {
+                for(unsigned int ct=0;ct<numRemaining[vertex];ct++) {
+                    unsigned int remainingTriangle=vertexTriangles[vertexTriangleOffsets[vertex]+ct];
+                    if(triangleScores[remainingTriangle]>bestScore) {
+                        bestScore=triangleScores[remainingTriangle];
+                        bestTriangle=remainingTriangle;
+                    }
+                }
+            }
+        }
+
+        //Number the vertices in the order they are first used, followed by the unused vertices
+        std::vector<unsigned int> newVertexIds(numVertices, std::numeric_limits<unsigned int>::max());
+        unsigned int numNewVertices=0;
+        for(auto& index: indices) {
+            if(newVertexIds[index]==std::numeric_limits<unsigned int>::max())
+                newVertexIds[index]=numNewVertices++;
+            index=newVertexIds[index];
+        }
+        for(auto& newVertexId: newVertexIds) {
+            if(newVertexId==std::numeric_limits<unsigned int>::max())
+                newVertexId=numNewVertices++;
+        }
+        mesh.indices=std::move(indices);
+
+        decltype(mesh.vertices) vertices(numVertices, aiVector3D(), mesh.vertices.get_allocator());
+        decltype(mesh.normals) normals(numVertices, aiVector3D(), mesh.normals.get_allocator());
+        decltype(mesh.textureCoords) textureCoords(mesh.textureCoords.size(), aiVector2D(), mesh.textureCoords.get_allocator());
+        for(unsigned int cv=0;cv<numVertices;cv++) {
+            vertices[newVertexIds[cv]]=mesh.vertices[cv];
+            normals[newVertexIds[cv]]=mesh.normals[cv];
+            if(!textureCoords.empty())
+                textureCoords[newVertexIds[cv]]=mesh.textureCoords[cv];
+        }
+        mesh.vertices=std::move(vertices);
+        mesh.normals=std::move(normals);
+        mesh.textureCoords=std::move(textureCoords);
+
+        return newVertexIds;
+    }
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //Writes the position, normal and texture coordinates of vertex cv of the given mesh to vertex, in the given format
+    static void writeVertex(const VertexFormat& format, const MeshType& mesh, unsigned int cv, unsigned char* vertex) {
+        GLfloat position[3]={mesh.vertices[cv].x, mesh.vertices[cv].y, mesh.vertices[cv].z};
+        std::memcpy(vertex, position, sizeof(position));
+        if(format.compact) {
+            GLbyte normal[4];
+            packNormal(mesh.normals[cv], normal);
+            std::memcpy(vertex+format.normalOffset, normal, sizeof(normal));
+        }
+        else {
+            GLfloat normal[3]={mesh.normals[cv].x, mesh.normals[cv].y, mesh.normals[cv].z};
+            std::memcpy(vertex+format.normalOffset, normal, sizeof(normal));
+        }
+        if(format.textureCoords && format.compact) {
+            uint16_t textureCoord[2]={packHalf(mesh.textureCoords[cv].x), packHalf(mesh.textureCoords[cv].y)};
+            std::memcpy(vertex+format.textureCoordOffset, textureCoord, sizeof(textureCoord));
+        }
+        else if(format.textureCoords) {
+            GLfloat textureCoord[2]={mesh.textureCoords[cv].x, mesh.textureCoords[cv].y};
+            std::memcpy(vertex+format.textureCoordOffset, textureCoord, sizeof(textureCoord));
+        }
+    }
+
+    //Upload the vertices, normals and texture coordinates of the given mesh interleaved, and its index buffer
+    void createBuffers(MeshType& mesh) {
+        mesh.vertexFormat=VertexFormat(compactVertices, !mesh.textureCoords.empty());
+        std::vector<unsigned char> vertices(mesh.vertices.size()*mesh.vertexFormat.size);
+        for(unsigned int cv=0;cv<mesh.vertices.size();cv++)
+            writeVertex(mesh.vertexFormat, mesh, cv, &vertices[cv*mesh.vertexFormat.size]);
+
+        mesh.vertexBuffer.create(GL_ARRAY_BUFFER, vertices);
+        createIndexBuffer(mesh);
+    }
+#endif
+
+    virtual void writeBaked(BakedWriter& writer) const {
+        writer.write<uint64_t>(materialDiffuseTextures.size());
+        for(auto& diffuseTextures: materialDiffuseTextures) {
+            writer.write<uint64_t>(diffuseTextures.size());
+            for(auto& diffuseTexture: diffuseTextures)
+                writer.writeString(diffuseTexture);
+        }
+
+        writer.write<uint64_t>(meshes.size());
+        for(auto& mesh: meshes) {
+            writer.write<uint32_t>(mesh.materialId);
+            writer.writeArray(mesh.vertices);
+            writer.writeArray(mesh.normals);
+            writer.writeArray(mesh.textureCoords);
+
+            writer.writeArray(mesh.indices);
+        }
+    }
+
+    //Replaces the materials and meshes of the model. Throws std::runtime_error if they are invalid.
+    virtual void readBaked(BakedReader& reader) {
+        materialDiffuseTextures.clear();
+        this->materials.clear();
+        meshes.clear();
+
+        //Recreate the materials from their diffuse textures
+        uint64_t numMaterials=reader.readCount(sizeof(uint64_t));
+        for(uint64_t cm=0;cm<numMaterials;cm++) {
+            materialDiffuseTextures.emplace_back();
+            auto& diffuseTextures=materialDiffuseTextures.back();
+            aiMaterial material;
+            uint64_t numDiffuseTextures=reader.readCount(sizeof(uint64_t));
+            for(uint64_t ct=0;ct<numDiffuseTextures;ct++) {
+                diffuseTextures.emplace_back(reader.readString());
+                aiString path(diffuseTextures.back());
+                material.AddProperty(&path, AI_MATKEY_TEXTURE_DIFFUSE(ct));
+            }
+            if(readMeshes)
+                this->materials.emplace_back(&material);
+        }
+
+        uint64_t numMeshes=reader.readCount(sizeof(uint32_t)+4*sizeof(uint64_t));
+        for(uint64_t cm=0;cm<numMeshes;cm++) {
+            this->meshes.emplace_back(meshes.get_allocator());
+            auto& mesh=meshes.back();
+
+            mesh.materialId=reader.read<uint32_t>();
+            reader.readArray(mesh.vertices);
+            reader.readArray(mesh.normals);
+            reader.readArray(mesh.textureCoords);
+
+            reader.readArray(mesh.indices);
+            if(mesh.materialId>=numMaterials || mesh.indices.size()%3!=0 || mesh.normals.size()!=mesh.vertices.size() ||
+               (!mesh.textureCoords.empty() && mesh.textureCoords.size()!=mesh.vertices.size()) ||
+               std::any_of(mesh.indices.begin(), mesh.indices.end(), [&mesh](unsigned int index) {return index>=mesh.vertices.size();}))
+                throw std::runtime_error("Model::readBaked: invalid mesh");
+        }
+    }
+
+    //Reads the whole model, see read(const aiScene*, JobSystem*).
+    //Without jobSystem, read(const aiScene*) is called instead, so that subclasses overriding it are still called.
+    virtual void readScene(const aiScene *scene, JobSystem* jobSystem) {
+        if(jobSystem)
+            read(scene, jobSystem);
+        else
+            read(scene);
+        if(optimizeMeshes) {
+            runJobs(jobSystem, meshes.size(), [this](size_t cm) {
+                optimizeMesh(meshes[cm]);
+            });
+        }
+    }
+
+    //Reads the materials and meshes without a job system, see read(const aiScene*, JobSystem*).
+    //Override read(const aiScene*, JobSystem*) instead to also be called by readAsync.
     virtual void read(const aiScene *scene) {
-        //Read materials and textures.
+        Model::read(scene, nullptr);
+    }
+
+    //Reads the materials and meshes, as parallel jobs if jobSystem is given. Does not use OpenGL, see upload.
+    virtual void read(const aiScene *scene, JobSystem* jobSystem) {
+        if(!readMeshes)
+            return;
+
+        //Read materials and textures, one job per material since the materials may decode texture files
+        std::vector<std::unique_ptr<MaterialType> > newMaterials(scene->mNumMaterials);
+        runJobs(jobSystem, scene->mNumMaterials, [scene, &newMaterials](size_t cm) {
+            newMaterials[cm].reset(new MaterialType(scene->mMaterials[cm]));
+        });
         for(unsigned int cm=0;cm<scene->mNumMaterials;cm++) {
-            this->materials.emplace_back(scene->mMaterials[cm]);
-        }
+            this->materials.emplace_back(std::move(*newMaterials[cm]));
 
-        //Read vertices, normals, texture coordinates, and material type
-        for(unsigned int cm=0;cm<scene->mNumMeshes;cm++) {
-            this->meshes.emplace_back();
+            materialDiffuseTextures.emplace_back();
+            for(unsigned int ct=0;ct<scene->mMaterials[cm]->GetTextureCount(aiTextureType_DIFFUSE);ct++) {
+                aiString path;
+                scene->mMaterials[cm]->GetTexture(aiTextureType_DIFFUSE, ct, &path);
+                materialDiffuseTextures[cm].emplace_back(path.C_Str());
+            }
+        }
 
+        //Read vertices, normals, texture coordinates, and material type, one job per mesh.
+        //The texture coordinates are read if present, since the material textures might not be created yet.
+        //Meshes without texture coordinates get none.
+        resizeWithAllocator(meshes, scene->mNumMeshes);
+        runJobs(jobSystem, scene->mNumMeshes, [this, scene](size_t cm) {
             const aiMesh *mesh = scene->mMeshes[cm];
 
             meshes[cm].materialId=mesh->mMaterialIndex;
 
             meshes[cm].vertices.resize(mesh->mNumVertices);
             meshes[cm].normals.resize(mesh->mNumVertices);
-            meshes[cm].textureCoords.resize(mesh->mNumVertices);
+            if(mesh->HasTextureCoords(0))
+                meshes[cm].textureCoords.resize(mesh->mNumVertices);
 
             for(unsigned int cv=0;cv<mesh->mNumVertices;cv++) {
                 meshes[cm].vertices[cv]=mesh->mVertices[cv];
                 meshes[cm].normals[cv]=mesh->mNormals[cv];
-                if(this->materials[meshes[cm].materialId].texture()) {
+                if(mesh->HasTextureCoords(0)) {
                     meshes[cm].textureCoords[cv].x=mesh->mTextureCoords[0][cv].x;
                     meshes[cm].textureCoords[cv].y=mesh->mTextureCoords[0][cv].y;
                 }
             }
-            meshes[cm].faces.resize(mesh->mNumFaces);
+            //Flatten the triangles into one index array. Points and lines are not drawn.
+            meshes[cm].indices.reserve(mesh->mNumFaces*3);
             for(unsigned int cf=0;cf<mesh->mNumFaces;cf++) {
-                meshes[cm].faces[cf]=mesh->mFaces[cf];
+                if(mesh->mFaces[cf].mNumIndices==3)
+                    meshes[cm].indices.insert(meshes[cm].indices.end(), mesh->mFaces[cf].mIndices, mesh->mFaces[cf].mIndices+3);
             }
-        }
+        });
     }
 };
 
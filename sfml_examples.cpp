@@ -19,6 +19,9 @@ const std::string modelPath="models/";
 //Class that defines how we are to handle materials, and especially textures, in the 3D model.
 //Only diffuse textures stored in external files are handled in this example
 class SFMLMaterial : Material {
+    //Decoded in the constructor, which may run on a worker thread, and uploaded to diffuseTextures in upload
+    std::vector<sf::Image> diffuseImages;
+
 public:
     std::vector<sf::Texture> diffuseTextures;
 
@@ -26,14 +29,19 @@ public:
         for(unsigned int cdt=0;cdt<material->GetTextureCount(aiTextureType_DIFFUSE);cdt++) {
             aiString path;
             material->GetTexture(aiTextureType_DIFFUSE, cdt, &path); //Assumes external texture files
-            sf::Image image;
-            image.loadFromFile(modelPath+path.C_Str());
+            diffuseImages.emplace_back();
+            diffuseImages[cdt].loadFromFile(modelPath+path.C_Str());
             //Need to vertically flip the textures read with SFML
-            image.flipVertically();
+            diffuseImages[cdt].flipVertically();
+        }
+    }
 
+    void upload() {
+        for(auto& image: diffuseImages) {
             diffuseTextures.emplace_back();
-            diffuseTextures[cdt].loadFromImage(image);
+            diffuseTextures.back().loadFromImage(image);
         }
+        diffuseImages.clear();
     }
     
     void bindTexture(aiTextureType textureType, unsigned int textureId) const {
@@ -45,16 +53,28 @@ public:
     }
 };
 
-//Example 1 - draws an unanimated model
+//Example 1 - draws an unanimated model, read in the background using Model::readAsync while the other examples are drawn
 class UnanimatedAstroBoy {
 public:
     Model<SFMLMaterial> model;
+    JobSystem jobSystem;
+    std::future<void> reading;
+    bool uploaded=false;
     
     UnanimatedAstroBoy() {
-        model.read(modelPath+"astroBoy_walk_Maya.dae");
+        //model.vertexBufferObjects=true; //uncomment to store the meshes in vertex buffer objects, drawn with one draw call per mesh
+        reading=model.readAsync(modelPath+"astroBoy_walk_Maya.dae", jobSystem);
     }
     
+    //Draws nothing until the model is read, and then creates its textures and buffers on the OpenGL thread once
     void draw() {
+        if(!uploaded) {
+            if(reading.wait_for(std::chrono::seconds(0))!=std::future_status::ready)
+                return;
+            reading.get();
+            model.upload();
+            uploaded=true;
+        }
         model.draw();
     }
 };
@@ -63,11 +83,17 @@ public:
 //SkeletalAnimationModel::createFrame makes the animation frame given animationId and time, 
 //SkeletalAnimationModel::getMeshFrame receives the frame vertices and normals for the given mesh, and
 //SkeletalAnimationModel::drawMeshFrame draws the given mesh frame. Example 3 and 4 show why we have these 3 functions.
+//Example 3, 4 and 6 also show how to share one model between many instances, each with its own Pose.
 class AstroBoy {
 public:
     SkeletalAnimationModel<SFMLMaterial> model; //template argument specifies how we are to handle textures
     
     AstroBoy() {
+        //model.gpuSkinning=true; //uncomment to skin on the GPU, drawFrame then uses drawMeshFrame(mesh) instead of getMeshFrame
+        //model.gpuInstancing=true; //uncomment together with gpuSkinning to draw the crowd in Example 6 with one draw call per mesh
+        //model.compactVertices=true; //uncomment together with gpuSkinning to halve the size of the vertex buffers
+        //model.dualQuaternionSkinning=true; //uncomment to skin with dual quaternions instead of blending bone matrices
+        //model.optimizeMeshes=true; //uncomment to reorder the triangles and vertices for the vertex caches
         model.read(modelPath+"astroBoy_walk_Maya.dae");
     }
     
@@ -84,17 +110,25 @@ public:
 
 //Example 3 - moves a mesh after the mesh of an animation frame is created.
 //Modification happens here between SkeletalAnimationModel::getMeshFrame and SkeletalAnimationModel::drawMeshFrame
+//The mesh frames are kept between frames, so that getMeshFrame does not allocate new vertices and normals every frame
+//The model is shared with Example 2, and this instance only stores its own Pose
 class AstroBoyMovingGlasses {
 public:
-    SkeletalAnimationModel<SFMLMaterial> model;
+    const SkeletalAnimationModel<SFMLMaterial>& model;
+    Pose pose;
+    std::vector<SkeletalAnimationModel<SFMLMaterial>::MeshFrame> meshFrames;
     
-    AstroBoyMovingGlasses(const SkeletalAnimationModel<SFMLMaterial>& model): model(model) {}
+    AstroBoyMovingGlasses(const SkeletalAnimationModel<SFMLMaterial>& model): model(model), pose(model.createPose()) {
+        for(auto& mesh: model.meshes)
+            meshFrames.emplace_back(mesh);
+    }
     
     //Draw the animation frame given time in seconds
     void drawFrame(double time) {
-        model.createFrame(0, time);
-        for(unsigned int cm=0;cm<model.meshes.size();cm++) {
-            auto meshFrame=model.getMeshFrame(model.meshes[cm]);
+        model.createFrame(pose, 0, time);
+        for(unsigned int cm=0;cm<meshFrames.size();cm++) {
+            auto& meshFrame=meshFrames[cm];
+            model.getMeshFrame(pose, meshFrame);
             if(cm==1) {
                 for(auto& vertex: meshFrame.vertices)
                     vertex.z+=4.0*(cos(time*10.0)+1.0);
@@ -104,29 +138,27 @@ public:
     }
 };
 
-//Example 4 - changing animation through direct manipulation of a bone transformation matrix
-//Modification happens here between SkeletalAnimationModel::createFrame and SkeletalAnimationModel::getMeshFrame
+//Example 4 - changing animation through a procedural override of a bone rotation
+//Modification happens here in SkeletalAnimationModel::createFrame, between sampling the animation and updating
+//the global bone transformations, without decomposing and recomposing the bone transformation matrix
+//The model is shared with Example 2, and the bone rotation is changed in this instance's Pose
 class AstroBoyHeadBanging {
 public:
-    SkeletalAnimationModel<SFMLMaterial> model;
+    const SkeletalAnimationModel<SFMLMaterial>& model;
+    Pose pose;
+    //Looked up once instead of every frame
+    unsigned int headBoneId;
     
-    AstroBoyHeadBanging(const SkeletalAnimationModel<SFMLMaterial>& model): model(model) {}
+    AstroBoyHeadBanging(const SkeletalAnimationModel<SFMLMaterial>& model): model(model), pose(model.createPose()), headBoneId(model.findBoneId("head")) {}
     
     //Draw the animation frame given time in seconds
     void drawFrame(double time) {
-        model.createFrame(0, time);
-        
-        unsigned int boneId=model.boneName2boneId.at("head");
-        aiVector3D oldScale;
-        aiQuaternion oldRotation;
-        aiVector3D oldPosition;
-        model.bones[boneId].transformation.Decompose(oldScale, oldRotation, oldPosition);
-        aiMatrix3x3 newRotation;
-        aiMatrix3x3::Rotation(cos(time*10.0), aiVector3D(0, 0, 1), newRotation);
-        model.bones[boneId].transformation=aiMatrix4x4Compose(oldScale, aiQuaternion(newRotation)*oldRotation, oldPosition);
+        model.createFrame(pose, 0, time, true, [this, time](BoneOverrides& overrides) {
+            overrides.setRotation(headBoneId, aiQuaternion(aiVector3D(0, 0, 1), cos(time*10.0))*overrides.rotation(headBoneId));
+        });
         
         for(auto& mesh: model.meshes) {
-            auto meshFrame=model.getMeshFrame(mesh);
+            auto meshFrame=model.getMeshFrame(pose, mesh);
             model.drawMeshFrame(meshFrame);
         }
     }
@@ -143,16 +175,10 @@ void printBoneHierarchy(const SkeletalAnimationModel<TextureHandler>& model) {
         }
     }
     
-    //map boneId to boneName
-    std::vector<std::string> boneId2BoneName(model.bones.size());
-    for(auto& p: model.boneName2boneId) {
-        boneId2BoneName[p.second]=p.first;
-    }
-    
     const std::function<void(unsigned int, unsigned int)> recursiveFunction=[&](unsigned int boneId, unsigned int level) {
         for(unsigned int c=0;c<level;c++)
             std::cout << "  ";
-        std::cout << boneId << " " << boneId2BoneName[boneId] << std::endl;
+        std::cout << boneId << " " << model.boneNames[boneId] << std::endl;
         for(unsigned int childBoneId: boneChildrenIds[boneId]) {
             recursiveFunction(childBoneId, level+1);
         }
@@ -164,6 +190,46 @@ void printBoneHierarchy(const SkeletalAnimationModel<TextureHandler>& model) {
     }
 }
 
+//Example 6 - creates the animation frames of many model instances in parallel using SkeletalAnimationModel::createFrames.
+//All the instances share one model. Only the drawing happens on the thread with the OpenGL context
+class AstroBoyCrowd {
+public:
+    const SkeletalAnimationModel<SFMLMaterial>& model;
+    std::vector<SkeletalAnimationModel<SFMLMaterial>::FrameJob> frameJobs;
+    std::vector<aiMatrix4x4> instanceTransformations;
+    JobSystem jobSystem;
+    
+    AstroBoyCrowd(const SkeletalAnimationModel<SFMLMaterial>& model, unsigned int size): model(model) {
+        for(unsigned int c=0;c<size;c++) {
+            frameJobs.emplace_back(model);
+            aiMatrix4x4 translation;
+            aiMatrix4x4::Translation(aiVector3D(-30.0+60.0*c/(size-1), 0.0, 40.0), translation);
+            instanceTransformations.emplace_back(translation);
+            frameJobs.back().worldTransformation=translation;
+        }
+    }
+    
+    //Draw the animation frames given time in seconds, each instance in its own phase of the animation
+    void drawFrame(double time) {
+        for(unsigned int cm=0;cm<frameJobs.size();cm++)
+            frameJobs[cm].time=time+cm*0.3;
+        //The instances outside the view are neither skinned nor drawn. 
+        //The OpenGL matrices are column major, and the model view matrix is the view matrix here.
+        GLfloat projection[16], view[16];
+        glGetFloatv(GL_PROJECTION_MATRIX, projection);
+        glGetFloatv(GL_MODELVIEW_MATRIX, view);
+        aiMatrix4x4 projectionMatrix(projection[0], projection[4], projection[8], projection[12], projection[1], projection[5], projection[9], projection[13],
+                                     projection[2], projection[6], projection[10], projection[14], projection[3], projection[7], projection[11], projection[15]);
+        aiMatrix4x4 viewMatrix(view[0], view[4], view[8], view[12], view[1], view[5], view[9], view[13],
+                               view[2], view[6], view[10], view[14], view[3], view[7], view[11], view[15]);
+        Frustum frustum(projectionMatrix*viewMatrix);
+        SkeletalAnimationModel<SFMLMaterial>::createFrames(jobSystem, frameJobs, &frustum);
+        
+        //One draw call per mesh if model.gpuInstancing is true
+        model.drawInstances(frameJobs, instanceTransformations);
+    }
+};
+
 //Create window, handle events, and OpenGL draw-function
 class SFMLApplication {
     sf::ContextSettings contextSettings;
@@ -174,11 +240,13 @@ class SFMLApplication {
     AstroBoy astroBoy;
     AstroBoyMovingGlasses astroBoyMovingGlasses;
     AstroBoyHeadBanging astroBoyHeadBanging;
+    AstroBoyCrowd astroBoyCrowd;
     
 public:
     SFMLApplication(): contextSettings(32), 
             window(sf::VideoMode(800, 600), "Skeletal Animation Library", sf::Style::Default, contextSettings),
-            astroBoyMovingGlasses(astroBoy.model), astroBoyHeadBanging(astroBoy.model) {
+            astroBoyMovingGlasses(astroBoy.model), astroBoyHeadBanging(astroBoy.model), 
+            astroBoyCrowd(astroBoy.model, 8) {
         //Output bone hierarchy of astroBoy model:
         printBoneHierarchy(astroBoy.model);
         
@@ -254,9 +322,13 @@ public:
             astroBoyMovingGlasses.drawFrame(time);
             glPopMatrix();
             
+            glPushMatrix();
             glRotatef(-time*50.0+270.0, 0.0, 1.0, 0.0);
             glTranslatef(20.0, 0.0, 0.0);            
             astroBoyHeadBanging.drawFrame(time);
+            glPopMatrix();
+            
+            astroBoyCrowd.drawFrame(time);
             
             //Swap buffer (show result)
             window.display();
@@ -2,8 +2,22 @@
 #define	SKELETAL_ANIMATION_MODEL_HPP
 
 #include "model.hpp"
+#include "job_system.hpp"
+#include "affine_transformation.hpp"
+#include "dual_quaternion.hpp"
+#include "bounding_box.hpp"
+#include "frame_statistics.hpp"
 
 #include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <limits>
 #include <functional>
 
 //Create animation frames of 3D models with skeletal animations imported using AssImp (http://assimp.sourceforge.net/)
@@ -11,13 +25,17 @@
 //Supports (for simplicity): vertices, normals, textures, and skeleton animations
 //Bone-related class structure:
 //SkeletalAnimationModel (derived from Model)
-//  0-many Bone (transformation)
+//  0-many Bone (transformation and globalTransformation, parent bones before child bones)
 //  0-many MeshExtended (derived from Mesh)
 //    0-many BoneWeights (offsetMatrix and vertex weights)
 //      1 boneId (position in Bone-vector)
+//    4 bone influences per vertex (position in BoneWeights-vector and weight)
 //  0-many Animation (duration, ticksPerSecond)
 //    0-many Channel (positions, rotations, and scales)
 //      1 boneId (position in Bone-vector)
+//Per-instance animation state, so that many instances can share one SkeletalAnimationModel:
+//Pose (transformations and globalTransformations, one per Bone)
+//The vectors of the meshes, bone weights and animations use the allocator of MeshType, for instance ArenaMeshExtended to allocate them from an Arena
 
 //For AssImp versions < 3.1 (I think). Will wait a year a so before I use the 3.1 aiMatrix4x4-constructor instead
 aiMatrix4x4 aiMatrix4x4Compose(const aiVector3D& scaling, const aiQuaternion& rotation, const aiVector3D& position) {
@@ -51,6 +69,9 @@ aiMatrix4x4 aiMatrix4x4Compose(const aiVector3D& scaling, const aiQuaternion& ro
 class Bone {
 public:
     aiMatrix4x4 transformation;
+    //transformation including the transformations of the parent bones, 
+    //see SkeletalAnimationModel::updateGlobalBoneTransformations
+    aiMatrix4x4 globalTransformation;
 
     unsigned int parentBoneId;
     bool hasParentBoneId;
@@ -58,171 +79,2482 @@ public:
     Bone(): hasParentBoneId(false) {}
 };
 
-class BoneWeights {
+//Allocated with Allocator as BasicMesh
+template<class Allocator=std::allocator<char> >
+class BasicBoneWeights {
 public:
+    typedef Allocator allocator_type;
+
     aiMatrix4x4 offsetMatrix;
-    std::vector<aiVertexWeight> weights;
+    //offsetMatrix converted once for skinning
+    AffineTransformation offsetTransformation;
+    AllocatorVector<aiVertexWeight, Allocator> weights;
+    //Bounding box of the bind-pose vertices with weights, transformed by offsetMatrix into the space of the bone.
+    //Created when the model is read, see SkeletalAnimationModel::getBoundingBox
+    BoundingBox boundingBox;
+
+    unsigned int boneId;
+
+    explicit BasicBoneWeights(const Allocator& allocator=Allocator()): weights(allocator) {}
+};
+
+typedef BasicBoneWeights<> BoneWeights;
+
+//Allocated with Allocator as BasicMesh, including the bone weights. 
+//MeshExtended uses std::allocator, and ArenaMeshExtended an Arena: Arena arena; SkeletalAnimationModel<Material, ArenaMeshExtended> model(arena);
+template<class Allocator=std::allocator<char> >
+class BasicMeshExtended : public BasicMesh<Allocator> {
+public:
+    AllocatorVector<BasicBoneWeights<Allocator>, Allocator> boneWeights;
+
+    //The 4 largest bone weights of each vertex, built from boneWeights in SkeletalAnimationModel::read.
+    //The weights are as read, renormalized to sum to 1 only if some vertex has more than 4 weights, see maxBoneWeightsPerVertex,
+    //so that skinning with the bone influences matches skinning with boneWeights.
+    //Vertex cv is influenced by the bones boneWeights[boneInfluenceIds[cv*4+c]].boneId 
+    //with weights boneInfluenceWeights[cv*4+c], c=0..3, sorted by decreasing weight
+    AllocatorVector<uint16_t, Allocator> boneInfluenceIds;
+    AllocatorVector<float, Allocator> boneInfluenceWeights;
+    //Largest number of bone weights of a vertex in boneWeights. 
+    //If larger than 4, the bone influences are an approximation and getMeshFrame uses boneWeights instead.
+    unsigned int maxBoneWeightsPerVertex=0;
+    //True if some vertices have no bone weights, and are then skinned to origo
+    bool unweightedVertices=false;
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //Bind-pose vertices with bone ids and weights, uploaded once when skinning on the GPU.
+    //Drawn using Mesh::indexBuffer. See SkeletalAnimationModel::gpuSkinning
+    GLBuffer skinningVertexBuffer;
+    VertexFormat skinningVertexFormat;
+#endif
+
+    explicit BasicMeshExtended(const Allocator& allocator=Allocator()): 
+            BasicMesh<Allocator>(allocator), boneWeights(allocator), boneInfluenceIds(allocator), boneInfluenceWeights(allocator) {}
+};
+
+typedef BasicMeshExtended<> MeshExtended;
+typedef BasicMeshExtended<ArenaAllocator<char> > ArenaMeshExtended;
+
+//Skins vertices and normals given the first numInfluences of the 4 bone influences per vertex (see MeshExtended::boneInfluenceIds),
+//streaming linearly over the vertices. Uses SSE or NEON when available.
+//palette holds a 3x4 matrix per bone stored column by column, padded to 16 floats, see AffineTransformation
+template<unsigned int numInfluences>
+inline void skinBoneInfluences(const float* palette, const uint16_t* boneIds, const float* weights,
+                               const aiVector3D* vertices, const aiVector3D* normals, size_t numVertices,
+                               aiVector3D* outVertices, aiVector3D* outNormals) {
+    static_assert(numInfluences>=1 && numInfluences<=4, "skinBoneInfluences: 1 to 4 influences per vertex");
+    for(size_t cv=0;cv<numVertices;cv++) {
+        const float* m[numInfluences];
+        for(unsigned int ci=0;ci<numInfluences;ci++)
+            m[ci]=palette+16*boneIds[cv*4+ci];
+        const float* w=weights+cv*4;
+        const aiVector3D& vertex=vertices[cv];
+        const aiVector3D& normal=normals[cv];
+#if defined(SKELETAL_ANIMATION_MODEL_SSE)
+        __m128 columns[4];
+        for(unsigned int c=0;c<4;c++) {
+            columns[c]=_mm_mul_ps(_mm_set1_ps(w[0]), _mm_loadu_ps(m[0]+c*4));
+            for(unsigned int ci=1;ci<numInfluences;ci++)
+                columns[c]=_mm_add_ps(columns[c], _mm_mul_ps(_mm_set1_ps(w[ci]), _mm_loadu_ps(m[ci]+c*4)));
+        }
+        __m128 outNormal=_mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(normal.x)), _mm_mul_ps(columns[1], _mm_set1_ps(normal.y))),
+                                    _mm_mul_ps(columns[2], _mm_set1_ps(normal.z)));
+        __m128 outVertex=_mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(vertex.x)), _mm_mul_ps(columns[1], _mm_set1_ps(vertex.y))),
+                                    _mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(vertex.z)), columns[3]));
+        float result[4];
+        _mm_storeu_ps(result, outVertex);
+        outVertices[cv]=aiVector3D(result[0], result[1], result[2]);
+        _mm_storeu_ps(result, outNormal);
+        outNormals[cv]=aiVector3D(result[0], result[1], result[2]);
+#elif defined(SKELETAL_ANIMATION_MODEL_NEON)
+        float32x4_t columns[4];
+        for(unsigned int c=0;c<4;c++) {
+            columns[c]=vmulq_n_f32(vld1q_f32(m[0]+c*4), w[0]);
+            for(unsigned int ci=1;ci<numInfluences;ci++)
+                columns[c]=vmlaq_n_f32(columns[c], vld1q_f32(m[ci]+c*4), w[ci]);
+        }
+        float32x4_t outNormal=vmulq_n_f32(columns[0], normal.x);
+        outNormal=vmlaq_n_f32(outNormal, columns[1], normal.y);
+        outNormal=vmlaq_n_f32(outNormal, columns[2], normal.z);
+        float32x4_t outVertex=vmlaq_n_f32(columns[3], columns[0], vertex.x);
+        outVertex=vmlaq_n_f32(outVertex, columns[1], vertex.y);
+        outVertex=vmlaq_n_f32(outVertex, columns[2], vertex.z);
+        float result[4];
+        vst1q_f32(result, outVertex);
+        outVertices[cv]=aiVector3D(result[0], result[1], result[2]);
+        vst1q_f32(result, outNormal);
+        outNormals[cv]=aiVector3D(result[0], result[1], result[2]);
+#else
+        float columns[16];
+        for(unsigned int c=0;c<16;c++) {
+            columns[c]=w[0]*m[0][c];
+            for(unsigned int ci=1;ci<numInfluences;ci++)
+                columns[c]+=w[ci]*m[ci][c];
+        }
+        outNormals[cv]=aiVector3D(columns[0]*normal.x+columns[4]*normal.y+columns[8]*normal.z,
+                                  columns[1]*normal.x+columns[5]*normal.y+columns[9]*normal.z,
+                                  columns[2]*normal.x+columns[6]*normal.y+columns[10]*normal.z);
+        outVertices[cv]=aiVector3D(columns[0]*vertex.x+columns[4]*vertex.y+columns[8]*vertex.z+columns[12],
+                                   columns[1]*vertex.x+columns[5]*vertex.y+columns[9]*vertex.z+columns[13],
+                                   columns[2]*vertex.x+columns[6]*vertex.y+columns[10]*vertex.z+columns[14]);
+#endif
+    }
+}
+
+//Same as above, with numInfluences from 1 to 4 given at run time
+inline void skinBoneInfluences(const float* palette, const uint16_t* boneIds, const float* weights,
+                               const aiVector3D* vertices, const aiVector3D* normals, size_t numVertices,
+                               aiVector3D* outVertices, aiVector3D* outNormals, unsigned int numInfluences=4) {
+    switch(numInfluences) {
+    case 1:
+        skinBoneInfluences<1>(palette, boneIds, weights, vertices, normals, numVertices, outVertices, outNormals);
+        break;
+    case 2:
+        skinBoneInfluences<2>(palette, boneIds, weights, vertices, normals, numVertices, outVertices, outNormals);
+        break;
+    case 3:
+        skinBoneInfluences<3>(palette, boneIds, weights, vertices, normals, numVertices, outVertices, outNormals);
+        break;
+    default:
+        skinBoneInfluences<4>(palette, boneIds, weights, vertices, normals, numVertices, outVertices, outNormals);
+    }
+}
+
+//Same as skinBoneInfluences, but blends the bone dual quaternions of each vertex instead of the bone matrices,
+//which preserves the volume around twisting joints.
+//palette holds 8 floats per bone, see DualQuaternion. Vertices with zero total weight end up in origo.
+template<unsigned int numInfluences>
+inline void skinBoneInfluencesDualQuaternion(const float* palette, const uint16_t* boneIds, const float* weights,
+                                             const aiVector3D* vertices, const aiVector3D* normals, size_t numVertices,
+                                             aiVector3D* outVertices, aiVector3D* outNormals) {
+    static_assert(numInfluences>=1 && numInfluences<=4, "skinBoneInfluencesDualQuaternion: 1 to 4 influences per vertex");
+    for(size_t cv=0;cv<numVertices;cv++) {
+        const float* q[numInfluences];
+        for(unsigned int ci=0;ci<numInfluences;ci++)
+            q[ci]=palette+8*boneIds[cv*4+ci];
+        //q and -q are the same rotation, so each dual quaternion is blended in the hemisphere of the first one
+        float w[numInfluences];
+        w[0]=weights[cv*4];
+        for(unsigned int ci=1;ci<numInfluences;ci++) {
+            float dot=q[0][0]*q[ci][0]+q[0][1]*q[ci][1]+q[0][2]*q[ci][2]+q[0][3]*q[ci][3];
+            //Without a branch, since the signs are unpredictable
+            w[ci]=std::copysign(weights[cv*4+ci], dot);
+        }
+#if defined(SKELETAL_ANIMATION_MODEL_SSE)
+        __m128 real=_mm_mul_ps(_mm_set1_ps(w[0]), _mm_loadu_ps(q[0]));
+        __m128 dual=_mm_mul_ps(_mm_set1_ps(w[0]), _mm_loadu_ps(q[0]+4));
+        for(unsigned int ci=1;ci<numInfluences;ci++) {
+            real=_mm_add_ps(real, _mm_mul_ps(_mm_set1_ps(w[ci]), _mm_loadu_ps(q[ci])));
+            dual=_mm_add_ps(dual, _mm_mul_ps(_mm_set1_ps(w[ci]), _mm_loadu_ps(q[ci]+4)));
+        }
+        __m128 lengthSquared=_mm_mul_ps(real, real);
+        lengthSquared=_mm_add_ps(lengthSquared, _mm_shuffle_ps(lengthSquared, lengthSquared, _MM_SHUFFLE(2, 3, 0, 1)));
+        lengthSquared=_mm_add_ps(lengthSquared, _mm_shuffle_ps(lengthSquared, lengthSquared, _MM_SHUFFLE(1, 0, 3, 2)));
+        if(_mm_cvtss_f32(lengthSquared)==0.0) {
+            outVertices[cv]=aiVector3D();
+            outNormals[cv]=aiVector3D();
+            continue;
+        }
+        __m128 inverseLength=_mm_div_ps(_mm_set1_ps(1.0), _mm_sqrt_ps(lengthSquared));
+        real=_mm_mul_ps(real, inverseLength);
+        dual=_mm_mul_ps(dual, inverseLength);
+        //See DualQuaternion::transformPoint and DualQuaternion::transformNormal
+        __m128 realW=_mm_shuffle_ps(real, real, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128 two=_mm_set1_ps(2.0);
+        __m128 translation=_mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(realW, dual), _mm_mul_ps(_mm_shuffle_ps(dual, dual, _MM_SHUFFLE(3, 3, 3, 3)), real)),
+                                                      crossProduct(real, dual)));
+        const aiVector3D& vertex=vertices[cv];
+        const aiVector3D& normal=normals[cv];
+        __m128 vertexVector=_mm_set_ps(0.0, vertex.z, vertex.y, vertex.x);
+        __m128 normalVector=_mm_set_ps(0.0, normal.z, normal.y, normal.x);
+        __m128 outVertex=_mm_add_ps(_mm_add_ps(vertexVector, translation), 
+                                    _mm_mul_ps(two, crossProduct(real, _mm_add_ps(crossProduct(real, vertexVector), _mm_mul_ps(realW, vertexVector)))));
+        __m128 outNormal=_mm_add_ps(normalVector, 
+                                    _mm_mul_ps(two, crossProduct(real, _mm_add_ps(crossProduct(real, normalVector), _mm_mul_ps(realW, normalVector)))));
+        float result[4];
+        _mm_storeu_ps(result, outVertex);
+        outVertices[cv]=aiVector3D(result[0], result[1], result[2]);
+        _mm_storeu_ps(result, outNormal);
+        outNormals[cv]=aiVector3D(result[0], result[1], result[2]);
+#else
+        DualQuaternion blended;
+#if defined(SKELETAL_ANIMATION_MODEL_NEON)
+        float32x4_t real=vmulq_n_f32(vld1q_f32(q[0]), w[0]);
+        float32x4_t dual=vmulq_n_f32(vld1q_f32(q[0]+4), w[0]);
+        for(unsigned int ci=1;ci<numInfluences;ci++) {
+            real=vmlaq_n_f32(real, vld1q_f32(q[ci]), w[ci]);
+            dual=vmlaq_n_f32(dual, vld1q_f32(q[ci]+4), w[ci]);
+        }
+        vst1q_f32(blended.real, real);
+        vst1q_f32(blended.dual, dual);
+#else
+        for(unsigned int c=0;c<4;c++) {
+            blended.real[c]=w[0]*q[0][c];
+            blended.dual[c]=w[0]*q[0][c+4];
+            for(unsigned int ci=1;ci<numInfluences;ci++) {
+                blended.real[c]+=w[ci]*q[ci][c];
+                blended.dual[c]+=w[ci]*q[ci][c+4];
+            }
+        }
+#endif
+        if(!blended.normalize()) {
+            outVertices[cv]=aiVector3D();
+            outNormals[cv]=aiVector3D();
+            continue;
+        }
+        outVertices[cv]=blended.transformPoint(vertices[cv]);
+        outNormals[cv]=blended.transformNormal(normals[cv]);
+#endif
+    }
+}
+
+//Same as above, with numInfluences from 1 to 4 given at run time
+inline void skinBoneInfluencesDualQuaternion(const float* palette, const uint16_t* boneIds, const float* weights,
+                                             const aiVector3D* vertices, const aiVector3D* normals, size_t numVertices,
+                                             aiVector3D* outVertices, aiVector3D* outNormals, unsigned int numInfluences=4) {
+    switch(numInfluences) {
+    case 1:
+        skinBoneInfluencesDualQuaternion<1>(palette, boneIds, weights, vertices, normals, numVertices, outVertices, outNormals);
+        break;
+    case 2:
+        skinBoneInfluencesDualQuaternion<2>(palette, boneIds, weights, vertices, normals, numVertices, outVertices, outNormals);
+        break;
+    case 3:
+        skinBoneInfluencesDualQuaternion<3>(palette, boneIds, weights, vertices, normals, numVertices, outVertices, outNormals);
+        break;
+    default:
+        skinBoneInfluencesDualQuaternion<4>(palette, boneIds, weights, vertices, normals, numVertices, outVertices, outNormals);
+    }
+}
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+//Vertex shader that skins the bind-pose vertices given a palette of bone matrices, 
+//and uses the fixed-function lighting state for OpenGL light 0.
+//Maximum 4 bone weights per vertex, and SKINNING_SHADER_MAX_BONES bones per mesh.
+//If instanced, the palettes of all the instances are read from a texture buffer (see BonePaletteTexture) instead of uniforms.
+//If dualQuaternion, the palette holds 2 vec4 per bone instead of a mat4, see DualQuaternion, blended as in skinBoneInfluencesDualQuaternion.
+//If transformFeedback, nothing is drawn: the skinned vertices, normals and texture coordinates are captured with transform feedback
+//in the layout of VertexFormat(false, true), see SkeletalAnimationModel::BufferFrame.
+#define SKINNING_SHADER_MAX_BONES 64
+class SkinningShader {
+    static GLuint compile(GLenum type, const std::string& source) {
+        GLuint shader=glCreateShader(type);
+        const char* sourcePointer=source.c_str();
+        glShaderSource(shader, 1, &sourcePointer, nullptr);
+        glCompileShader(shader);
+
+        GLint status;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if(status!=GL_TRUE) {
+            GLint length;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            std::string log(length, '\0');
+            glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+            glDeleteShader(shader);
+            throw std::runtime_error("SkinningShader: could not compile shader: "+log);
+        }
+        return shader;
+    }
+
+public:
+    GLuint program;
+    bool dualQuaternion;
+    bool transformFeedback;
+
+    //The bone palette: bone matrices, or dual quaternions if dualQuaternion
+    GLint boneMatricesLocation;
+    //Bones per instance in the texture buffer, if instanced
+    GLint numBonesLocation;
+    GLint textureLocation;
+    GLint hasTextureLocation;
+    GLint boneIdsLocation;
+    GLint boneWeightsLocation;
+
+    //Requires OpenGL 2.0 and a current OpenGL context.
+    //If instanced, requires OpenGL 3.1 or the ARB_draw_instanced, ARB_texture_buffer_object and EXT_gpu_shader4 extensions.
+    //If transformFeedback, requires OpenGL 3.0, and instanced is not supported.
+    SkinningShader(bool instanced=false, bool dualQuaternion=false, bool transformFeedback=false): 
+            dualQuaternion(dualQuaternion), transformFeedback(transformFeedback) {
+        if(instanced && transformFeedback)
+            throw std::runtime_error("SkinningShader: instanced transform feedback is not supported");
+        std::string boneMatrixSource;
+        if(instanced && dualQuaternion) {
+            boneMatrixSource=
+                "#extension GL_EXT_gpu_shader4 : require\n"
+                "#extension GL_ARB_draw_instanced : require\n"
+                "uniform samplerBuffer boneMatrices;\n"
+                "uniform int numBones;\n"
+                "mat2x4 boneDualQuaternion(float boneId) {\n"
+                "    int offset=(gl_InstanceIDARB*numBones+int(boneId))*2;\n"
+                "    return mat2x4(texelFetchBuffer(boneMatrices, offset), texelFetchBuffer(boneMatrices, offset+1));\n"
+                "}\n";
+        }
+        else if(dualQuaternion) {
+            boneMatrixSource=
+                "uniform vec4 boneMatrices["+std::to_string(SKINNING_SHADER_MAX_BONES*2)+"];\n"
+                "mat2x4 boneDualQuaternion(float boneId) {\n"
+                "    return mat2x4(boneMatrices[int(boneId)*2], boneMatrices[int(boneId)*2+1]);\n"
+                "}\n";
+        }
+        else if(instanced) {
+            boneMatrixSource=
+                "#extension GL_EXT_gpu_shader4 : require\n"
+                "#extension GL_ARB_draw_instanced : require\n"
+                "uniform samplerBuffer boneMatrices;\n"
+                "uniform int numBones;\n"
+                "mat4 boneMatrix(float boneId) {\n"
+                "    int offset=(gl_InstanceIDARB*numBones+int(boneId))*4;\n"
+                "    return mat4(texelFetchBuffer(boneMatrices, offset), texelFetchBuffer(boneMatrices, offset+1),\n"
+                "                texelFetchBuffer(boneMatrices, offset+2), texelFetchBuffer(boneMatrices, offset+3));\n"
+                "}\n";
+        }
+        else {
+            boneMatrixSource=
+                "uniform mat4 boneMatrices["+std::to_string(SKINNING_SHADER_MAX_BONES)+"];\n"
+                "mat4 boneMatrix(float boneId) {\n"
+                "    return boneMatrices[int(boneId)];\n"
+                "}\n";
+        }
+        std::string skinningSource;
+        if(dualQuaternion) {
+            skinningSource=
+                "    mat2x4 first=boneDualQuaternion(boneIds.x);\n"
+                "    mat2x4 second=boneDualQuaternion(boneIds.y);\n"
+                "    mat2x4 third=boneDualQuaternion(boneIds.z);\n"
+                "    mat2x4 fourth=boneDualQuaternion(boneIds.w);\n"
+                "    mat2x4 blended=boneWeights.x*first+\n"
+                "                   (dot(first[0], second[0])<0.0 ? -boneWeights.y : boneWeights.y)*second+\n"
+                "                   (dot(first[0], third[0])<0.0 ? -boneWeights.z : boneWeights.z)*third+\n"
+                "                   (dot(first[0], fourth[0])<0.0 ? -boneWeights.w : boneWeights.w)*fourth;\n"
+                "    float blendedLength=length(blended[0]);\n"
+                "    vec4 skinnedVertex=vec4(0.0, 0.0, 0.0, 1.0);\n"
+                "    vec3 skinnedNormal=vec3(0.0);\n"
+                "    if(blendedLength>0.0) {\n"
+                "        vec4 real=blended[0]/blendedLength;\n"
+                "        vec4 dual=blended[1]/blendedLength;\n"
+                "        skinnedNormal=gl_Normal+2.0*cross(real.xyz, cross(real.xyz, gl_Normal)+real.w*gl_Normal);\n"
+                "        skinnedVertex.xyz=gl_Vertex.xyz+2.0*cross(real.xyz, cross(real.xyz, gl_Vertex.xyz)+real.w*gl_Vertex.xyz)+\n"
+                "                          2.0*(real.w*dual.xyz-dual.w*real.xyz+cross(real.xyz, dual.xyz));\n"
+                "    }\n";
+        }
+        else {
+            skinningSource=
+                "    mat4 transformation=boneWeights.x*boneMatrix(boneIds.x)+\n"
+                "                        boneWeights.y*boneMatrix(boneIds.y)+\n"
+                "                        boneWeights.z*boneMatrix(boneIds.z)+\n"
+                "                        boneWeights.w*boneMatrix(boneIds.w);\n"
+                "    vec4 skinnedVertex=transformation*gl_Vertex;\n"
+                "    vec3 skinnedNormal=mat3(transformation)*gl_Normal;\n";
+        }
+        const std::string feedbackVertexShaderSource=
+            "#version 120\n"+
+            boneMatrixSource+
+            "attribute vec4 boneIds;\n"
+            "attribute vec4 boneWeights;\n"
+            "varying vec3 feedbackVertex;\n"
+            "varying vec3 feedbackNormal;\n"
+            "varying vec2 feedbackTextureCoord;\n"
+            "void main() {\n"+
+            skinningSource+
+            "    feedbackVertex=skinnedVertex.xyz;\n"
+            "    feedbackNormal=skinnedNormal;\n"
+            "    feedbackTextureCoord=gl_MultiTexCoord0.st;\n"
+            "    gl_Position=vec4(0.0, 0.0, 0.0, 1.0);\n"
+            "}\n";
+        const std::string vertexShaderSource=
+            "#version 120\n"+
+            boneMatrixSource+
+            "attribute vec4 boneIds;\n"
+            "attribute vec4 boneWeights;\n"
+            "void main() {\n"+
+            skinningSource+
+            "    vec4 position=gl_ModelViewMatrix*skinnedVertex;\n"
+            "    vec3 normal=normalize(gl_NormalMatrix*skinnedNormal);\n"
+            "    vec3 lightDirection;\n"
+            "    if(gl_LightSource[0].position.w==0.0)\n"
+            "        lightDirection=normalize(gl_LightSource[0].position.xyz);\n"
+            "    else\n"
+            "        lightDirection=normalize(gl_LightSource[0].position.xyz-position.xyz);\n"
+            "    gl_FrontColor=gl_FrontLightModelProduct.sceneColor+gl_FrontLightProduct[0].ambient+\n"
+            "                  gl_FrontLightProduct[0].diffuse*max(dot(normal, lightDirection), 0.0);\n"
+            "    gl_TexCoord[0]=gl_MultiTexCoord0;\n"
+            "    gl_Position=gl_ProjectionMatrix*position;\n"
+            "}\n";
+        const std::string fragmentShaderSource=
+            "#version 120\n"
+            "uniform sampler2D diffuseTexture;\n"
+            "uniform bool hasTexture;\n"
+            "void main() {\n"
+            "    if(hasTexture)\n"
+            "        gl_FragColor=gl_Color*texture2D(diffuseTexture, gl_TexCoord[0].st);\n"
+            "    else\n"
+            "        gl_FragColor=gl_Color;\n"
+            "}\n";
+
+        GLuint vertexShader=compile(GL_VERTEX_SHADER, transformFeedback ? feedbackVertexShaderSource : vertexShaderSource);
+        GLuint fragmentShader=transformFeedback ? 0 : compile(GL_FRAGMENT_SHADER, fragmentShaderSource);
+
+        program=glCreateProgram();
+        glAttachShader(program, vertexShader);
+        if(transformFeedback) {
+            const char* varyings[]={"feedbackVertex", "feedbackNormal", "feedbackTextureCoord"};
+            glTransformFeedbackVaryings(program, 3, varyings, GL_INTERLEAVED_ATTRIBS);
+        }
+        else
+            glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+        glDeleteShader(vertexShader);
+        if(fragmentShader)
+            glDeleteShader(fragmentShader);
+
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if(status!=GL_TRUE) {
+            GLint length;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+            std::string log(length, '\0');
+            glGetProgramInfoLog(program, length, nullptr, &log[0]);
+            glDeleteProgram(program);
+            throw std::runtime_error("SkinningShader: could not link program: "+log);
+        }
+
+        boneMatricesLocation=glGetUniformLocation(program, "boneMatrices");
+        numBonesLocation=glGetUniformLocation(program, "numBones");
+        textureLocation=glGetUniformLocation(program, "diffuseTexture");
+        hasTextureLocation=glGetUniformLocation(program, "hasTexture");
+        boneIdsLocation=glGetAttribLocation(program, "boneIds");
+        boneWeightsLocation=glGetAttribLocation(program, "boneWeights");
+    }
+
+    ~SkinningShader() {
+        glDeleteProgram(program);
+    }
+
+    SkinningShader(const SkinningShader&)=delete;
+    SkinningShader& operator=(const SkinningShader&)=delete;
+};
+
+//Texture buffer with the bone palettes of many instances, 4 RGBA texels per bone matrix (see AffineTransformation)
+//or 2 per dual quaternion (see DualQuaternion),
+//used by the instanced SkinningShader
+class BonePaletteTexture {
+public:
+    GLuint texture;
+    GLBuffer buffer;
+
+    //Requires OpenGL 3.1 or the ARB_texture_buffer_object extension, and a current OpenGL context
+    BonePaletteTexture() {
+        buffer.create(GL_TEXTURE_BUFFER, std::vector<AffineTransformation>(1), GL_STREAM_DRAW);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer.id());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    ~BonePaletteTexture() {
+        glDeleteTextures(1, &texture);
+    }
+
+    BonePaletteTexture(const BonePaletteTexture&)=delete;
+    BonePaletteTexture& operator=(const BonePaletteTexture&)=delete;
+};
+#endif
+
+//Unit quaternion stored in 6 bytes as its 3 smallest components, each quantized to 15 bits.
+//The largest component is recomputed from the others, and its index is stored in the remaining bits.
+class QuantizedQuaternion {
+public:
+    uint16_t values[3];
+
+    QuantizedQuaternion() {}
+
+    explicit QuantizedQuaternion(const aiQuaternion& quaternion) {
+        float components[4]={quaternion.w, quaternion.x, quaternion.y, quaternion.z};
+        float length=std::sqrt(components[0]*components[0]+components[1]*components[1]+components[2]*components[2]+components[3]*components[3]);
+        unsigned int largest=0;
+        for(unsigned int c=1;c<4;c++) {
+            if(std::abs(components[c])>std::abs(components[largest]))
+                largest=c;
+        }
+        //q and -q are the same rotation, so the largest component is made positive
+        float sign=components[largest]<0.0 ? -1.0 : 1.0;
+
+        unsigned int cv=0;
+        for(unsigned int c=0;c<4;c++) {
+            if(c!=largest) {
+                //The smallest components are in [-1/sqrt(2), 1/sqrt(2)]
+                float value=sign*components[c]/length*1.41421356f*0.5+0.5;
+                value=std::min(std::max(value, 0.0f), 1.0f);
+                values[cv]=static_cast<uint16_t>(value*32767.0+0.5)<<1;
+                cv++;
+            }
+        }
+        values[0]|=largest&1;
+        values[1]|=(largest>>1)&1;
+    }
+
+    aiQuaternion get() const {
+        unsigned int largest=(values[0]&1)|((values[1]&1)<<1);
+        float components[4];
+        float sum=0.0;
+        unsigned int cv=0;
+        for(unsigned int c=0;c<4;c++) {
+            if(c!=largest) {
+                components[c]=((values[cv]>>1)*(1.0f/32767.0f)*2.0f-1.0f)*0.70710678f;
+                sum+=components[c]*components[c];
+                cv++;
+            }
+        }
+        components[largest]=std::sqrt(std::max(1.0f-sum, 0.0f));
+        return aiQuaternion(components[0], components[1], components[2], components[3]);
+    }
+};
+
+//Key indices found in the previous interpolate calls of a channel, see BasicAnimation::interpolate(keys, time, loop, keyCursor).
+//The same for all allocators, so that a Pose does not depend on the allocator of the model.
+class AnimationChannelCursor {
+public:
+    unsigned int position=0;
+    unsigned int rotation=0;
+    unsigned int scale=0;
+};
+
+//The channels and their keys are allocated with Allocator as BasicMesh. Animation uses std::allocator.
+template<class Allocator=std::allocator<char> >
+class BasicAnimation {
+public:
+    typedef Allocator allocator_type;
+
+    //Keys with single precision time, used in compressed channels, see Animation::compress
+    class CompressedVectorKey {
+    public:
+        float mTime;
+        aiVector3D mValue;
+    };
+    class CompressedQuatKey {
+    public:
+        float mTime;
+        QuantizedQuaternion mValue;
+    };
+
+    class Channel {
+    public:
+        typedef Allocator allocator_type;
+
+        unsigned int boneId;
+
+        AllocatorVector<aiVectorKey, Allocator> positions;
+        AllocatorVector<aiQuatKey, Allocator> rotations;
+        AllocatorVector<aiVectorKey, Allocator> scales;
+
+        //Used instead of positions, rotations and scales after Animation::compress
+        AllocatorVector<CompressedVectorKey, Allocator> compressedPositions;
+        AllocatorVector<CompressedQuatKey, Allocator> compressedRotations;
+        AllocatorVector<CompressedVectorKey, Allocator> compressedScales;
+
+        explicit Channel(const Allocator& allocator=Allocator()): positions(allocator), rotations(allocator), scales(allocator), 
+                compressedPositions(allocator), compressedRotations(allocator), compressedScales(allocator) {}
+
+        bool compressed() const {
+            return !compressedPositions.empty() || !compressedRotations.empty() || !compressedScales.empty();
+        }
+    };
+
+    double duration;
+    double ticksPerSecond;
+
+    AllocatorVector<Channel, Allocator> channels;
+
+    explicit BasicAnimation(const Allocator& allocator=Allocator()): channels(allocator) {}
+
+private:
+    static const aiVector3D& decode(const aiVector3D& value) {return value;}
+    static const aiQuaternion& decode(const aiQuaternion& value) {return value;}
+    static aiQuaternion decode(const QuantizedQuaternion& value) {return value.get();}
+
+    //Value type returned when interpolating keys of type KeyType
+    template<class KeyType>
+    using ValueType=typename std::decay<decltype(decode(std::declval<KeyType>().mValue))>::type;
+
+    static double difference(const aiVector3D& a, const aiVector3D& b) {
+        return (a-b).Length();
+    }
+    //Angle between the rotations
+    static double difference(const aiQuaternion& a, const aiQuaternion& b) {
+        double dot=std::abs(a.w*b.w+a.x*b.x+a.y*b.y+a.z*b.z);
+        return 2.0*std::acos(std::min(dot, 1.0));
+    }
+
+    aiVector3D interpolateFunction(const aiVector3D& beforeMatrix, const aiVector3D& afterMatrix, double factor) const {
+        aiVector3D diffMatrix=afterMatrix-beforeMatrix;
+        diffMatrix*=factor;
+
+        return beforeMatrix+diffMatrix;
+    }
+    aiQuaternion interpolateFunction(const aiQuaternion& beforeMatrix, const aiQuaternion& afterMatrix, double factor) const {
+        aiQuaternion returnMatrix;
+        aiQuaternion::Interpolate(returnMatrix, beforeMatrix, afterMatrix, factor);
+
+        return returnMatrix;
+    }
+    //Returns the index of the first key after time, or keys.size() if there is none.
+    //The hinted key and the one following it are checked before falling back to a binary search.
+    template<class KeyType, class KeyAllocator>
+    static unsigned int findKeyAfter(const std::vector<KeyType, KeyAllocator>& keys, double time, unsigned int keyHint) {
+        for(unsigned int ck=keyHint;ck<keyHint+2 && ck<=keys.size();ck++) {
+            if((ck==keys.size() || time<keys[ck].mTime) && (ck==0 || keys[ck-1].mTime<=time)) {
+                SKELETAL_ANIMATION_MODEL_COUNT(KEYS_SCANNED, ck-keyHint+1);
+                return ck;
+            }
+        }
+        SKELETAL_ANIMATION_MODEL_COUNT(KEYS_SCANNED, 2+static_cast<unsigned int>(std::log2(keys.size()+1)));
+        return std::upper_bound(keys.begin(), keys.end(), time, [](double time, const KeyType& key) {
+            return time<key.mTime;
+        })-keys.begin();
+    }
+
+    //Removes keys that can be interpolated from the remaining keys within the given tolerance.
+    //The first and last keys are kept, except for constant channels that are reduced to a single key.
+    template<class KeyType, class KeyAllocator>
+    void reduceKeys(std::vector<KeyType, KeyAllocator>& keys, double tolerance) const {
+        if(keys.size()<2)
+            return;
+
+        bool constant=true;
+        for(unsigned int ck=1;ck<keys.size() && constant;ck++)
+            constant=difference(keys[ck].mValue, keys[0].mValue)<=tolerance;
+        if(constant) {
+            keys.resize(1);
+            return;
+        }
+
+        std::vector<KeyType, KeyAllocator> reducedKeys(keys.get_allocator());
+        reducedKeys.emplace_back(keys[0]);
+        unsigned int keyBefore=0;
+        for(unsigned int ck=1;ck+1<keys.size();ck++) {
+            //Keep key ck if the keys after keyBefore up to ck cannot be interpolated from keyBefore to ck+1
+            bool redundant=true;
+            for(unsigned int c=keyBefore+1;c<=ck && redundant;c++) {
+                double factor=(keys[c].mTime-keys[keyBefore].mTime)/(keys[ck+1].mTime-keys[keyBefore].mTime);
+                redundant=difference(interpolateFunction(keys[keyBefore].mValue, keys[ck+1].mValue, factor), keys[c].mValue)<=tolerance;
+            }
+            if(!redundant) {
+                reducedKeys.emplace_back(keys[ck]);
+                keyBefore=ck;
+            }
+        }
+        reducedKeys.emplace_back(keys.back());
+        keys=std::move(reducedKeys);
+    }
+
+    //Interpolates at time in ticks, in [0, duration) when looping
+    template<class KeyType, class KeyAllocator>
+    ValueType<KeyType> interpolateTicks(const std::vector<KeyType, KeyAllocator>& keys, double time, unsigned int& keyCursor) const {
+        keyCursor=findKeyAfter(keys, time, keyCursor);
+
+        unsigned int keyBefore=0, keyAfter=0;
+        double frameDuration=1.0, frameTime=0.0;
+        if(keyCursor<keys.size()) {
+            keyAfter=keyCursor;
+            if(keyAfter==0) {
+                keyBefore=keys.size()-1;
+                frameDuration=keys[0].mTime;
+                frameTime=time;
+            }
+            else {
+                keyBefore=keyAfter-1;
+                frameDuration=keys[keyAfter].mTime-keys[keyBefore].mTime;
+                frameTime=time-keys[keyBefore].mTime;
+            }
+        }
+
+        double factor=frameTime/frameDuration;
+
+        return interpolateFunction(decode(keys[keyBefore].mValue), decode(keys[keyAfter].mValue), factor);
+    }
+
+public:
+    typedef AnimationChannelCursor ChannelCursor;
+
+    //time in seconds
+    template<class KeyType, class KeyAllocator>
+    ValueType<KeyType> interpolate(const std::vector<KeyType, KeyAllocator>& keys, double time, bool loop=true) const {
+        unsigned int keyCursor=0;
+        return interpolate(keys, time, loop, keyCursor);
+    }
+
+    //time in seconds
+    //keyCursor is used as a hint for where to find the keys, and is updated for the next call.
+    //Finding the keys is O(1) when time increases monotonically between calls, and O(log(keys.size())) otherwise.
+    template<class KeyType, class KeyAllocator>
+    ValueType<KeyType> interpolate(const std::vector<KeyType, KeyAllocator>& keys, double time, bool loop, unsigned int& keyCursor) const {
+        time*=ticksPerSecond;
+
+        if(loop) {
+            time=fmod(time, duration);
+        }
+        else if(time>=duration) {
+            return decode(keys[keys.size()-1].mValue);
+        }
+
+        return interpolateTicks(keys, time, keyCursor);
+    }
+
+    //Interpolates the scale, rotation and position of the given channel, compressed or not.
+    //time in seconds
+    void interpolate(const Channel& channel, double time, bool loop, ChannelCursor& cursor, 
+                     aiVector3D& scale, aiQuaternion& rotation, aiVector3D& position) const {
+        //Convert the time once for the three key arrays
+        double ticks=time*ticksPerSecond;
+        bool end=false;
+        if(loop)
+            ticks=fmod(ticks, duration);
+        else if(ticks>=duration)
+            end=true;
+
+        if(channel.compressed()) {
+            scale=end ? channel.compressedScales.back().mValue : interpolateTicks(channel.compressedScales, ticks, cursor.scale);
+            rotation=end ? channel.compressedRotations.back().mValue.get() : interpolateTicks(channel.compressedRotations, ticks, cursor.rotation);
+            position=end ? channel.compressedPositions.back().mValue : interpolateTicks(channel.compressedPositions, ticks, cursor.position);
+        }
+        else {
+            scale=end ? channel.scales.back().mValue : interpolateTicks(channel.scales, ticks, cursor.scale);
+            rotation=end ? channel.rotations.back().mValue : interpolateTicks(channel.rotations, ticks, cursor.rotation);
+            position=end ? channel.positions.back().mValue : interpolateTicks(channel.positions, ticks, cursor.position);
+        }
+    }
+
+    //Removes keys that can be interpolated from the remaining keys within the given tolerances,
+    //for instance all but one key of constant channels.
+    //rotationTolerance is in radians, and positionTolerance and scaleTolerance in model units.
+    void reduceKeys(double positionTolerance=1e-4, double rotationTolerance=1e-4, double scaleTolerance=1e-4) {
+        for(auto& channel: channels) {
+            reduceKeys(channel.positions, positionTolerance);
+            reduceKeys(channel.rotations, rotationTolerance);
+            reduceKeys(channel.scales, scaleTolerance);
+        }
+    }
+
+    //Reduces the keys, see reduceKeys, and converts the channels to compressed keys 
+    //with single precision time and quantized rotations (see QuantizedQuaternion).
+    //The uncompressed keys are cleared. Channels without keys are left uncompressed.
+    void compress(double positionTolerance=1e-4, double rotationTolerance=1e-4, double scaleTolerance=1e-4) {
+        reduceKeys(positionTolerance, rotationTolerance, scaleTolerance);
+        for(auto& channel: channels) {
+            if(channel.positions.empty() || channel.rotations.empty() || channel.scales.empty())
+                continue;
+
+            channel.compressedPositions.clear();
+            channel.compressedPositions.reserve(channel.positions.size());
+            for(auto& key: channel.positions)
+                channel.compressedPositions.emplace_back(CompressedVectorKey{static_cast<float>(key.mTime), key.mValue});
+            channel.compressedRotations.clear();
+            channel.compressedRotations.reserve(channel.rotations.size());
+            for(auto& key: channel.rotations)
+                channel.compressedRotations.emplace_back(CompressedQuatKey{static_cast<float>(key.mTime), QuantizedQuaternion(key.mValue)});
+            channel.compressedScales.clear();
+            channel.compressedScales.reserve(channel.scales.size());
+            for(auto& key: channel.scales)
+                channel.compressedScales.emplace_back(CompressedVectorKey{static_cast<float>(key.mTime), key.mValue});
+
+            decltype(channel.positions)(channel.positions.get_allocator()).swap(channel.positions);
+            decltype(channel.rotations)(channel.rotations.get_allocator()).swap(channel.rotations);
+            decltype(channel.scales)(channel.scales.get_allocator()).swap(channel.scales);
+        }
+    }
+};
+
+typedef BasicAnimation<> Animation;
+
+//Bone transformations with the scale, rotation and position kept separate, so that they can be blended 
+//before the transformation matrices are composed. Indexed by boneId.
+class LocalPose {
+public:
+    std::vector<aiVector3D> scales;
+    std::vector<aiQuaternion> rotations;
+    std::vector<aiVector3D> positions;
+};
+
+template<class MaterialType, class MeshType> class SkeletalAnimationModel;
+
+//Bone transformations replacing the sampled LocalPose during one frame, set by the overrideBones function 
+//given to SkeletalAnimationModel::createFrame, for instance for look-at or IK.
+//Only the overridden bones and their descendants are then updated. The overrides are undone when the next frame is created.
+class BoneOverrides {
+    template<class MaterialType, class MeshType> friend class SkeletalAnimationModel;
+
+    class Override {
+    public:
+        unsigned int boneId;
+        aiVector3D scale;
+        aiQuaternion rotation;
+        aiVector3D position;
+    };
+    //Usually only a few bones are overridden, so they are searched linearly
+    std::vector<Override> overrides;
+    const LocalPose* localPose=nullptr;
+
+    const Override* findOverride(unsigned int boneId) const {
+        for(auto& boneOverride: overrides) {
+            if(boneOverride.boneId==boneId)
+                return &boneOverride;
+        }
+        return nullptr;
+    }
+
+    Override& getOverride(unsigned int boneId) {
+        for(auto& boneOverride: overrides) {
+            if(boneOverride.boneId==boneId)
+                return boneOverride;
+        }
+        overrides.emplace_back();
+        auto& boneOverride=overrides.back();
+        boneOverride.boneId=boneId;
+        boneOverride.scale=localPose->scales[boneId];
+        boneOverride.rotation=localPose->rotations[boneId];
+        boneOverride.position=localPose->positions[boneId];
+        return boneOverride;
+    }
+
+public:
+    //The local pose of the frame before the overrides
+    const LocalPose& sampledPose() const {
+        return *localPose;
+    }
+
+    //The scale, rotation and position of the bone: overridden, or else sampled
+    const aiVector3D& scale(unsigned int boneId) const {
+        auto boneOverride=findOverride(boneId);
+        return boneOverride ? boneOverride->scale : localPose->scales[boneId];
+    }
+    const aiQuaternion& rotation(unsigned int boneId) const {
+        auto boneOverride=findOverride(boneId);
+        return boneOverride ? boneOverride->rotation : localPose->rotations[boneId];
+    }
+    const aiVector3D& position(unsigned int boneId) const {
+        auto boneOverride=findOverride(boneId);
+        return boneOverride ? boneOverride->position : localPose->positions[boneId];
+    }
+
+    void setScale(unsigned int boneId, const aiVector3D& scale) {
+        getOverride(boneId).scale=scale;
+    }
+    void setRotation(unsigned int boneId, const aiQuaternion& rotation) {
+        getOverride(boneId).rotation=rotation;
+    }
+    void setPosition(unsigned int boneId, const aiVector3D& position) {
+        getOverride(boneId).position=position;
+    }
+};
+
+//An animation sampled at the given time and blended over the layers before it, 
+//see SkeletalAnimationModel::createFrame taking layers
+class AnimationLayer {
+public:
+    unsigned int animationId;
+    double time;
+    bool loop;
+
+    //0 leaves the result of the previous layers, and 1 replaces it
+    float weight;
+    //Optional weight per boneId, multiplied with weight. 
+    //For instance an upper body layer, see SkeletalAnimationModel::createBoneMask.
+    const std::vector<float>* boneMask;
+
+    AnimationLayer(unsigned int animationId=0, double time=0.0, bool loop=true, float weight=1.0, const std::vector<float>* boneMask=nullptr): 
+            animationId(animationId), time(time), loop(loop), weight(weight), boneMask(boneMask) {}
+};
+
+//Global bone transformations of an animation sampled at a fixed rate, see SkeletalAnimationModel::bakeAnimations
+class BakedAnimation {
+public:
+    //Adjusted so that the frames evenly divide the animation
+    double framesPerSecond=0.0;
+    //in seconds
+    double duration=0.0;
+    unsigned int numBones=0;
+    //numFrames()+1 frames of numBones global bone transformations each. 
+    //Frame cf is sampled at cf/framesPerSecond, the last frame at duration.
+    std::vector<AffineTransformation> frames;
+
+    unsigned int numFrames() const {
+        return numBones>0 && frames.size()>0 ? frames.size()/numBones-1 : 0;
+    }
+};
+
+//The arguments of the createFrame or createBakedFrame call that created the current bone transformations,
+//used to skip the frame when it is created again with the same arguments, for instance for paused instances.
+//After changing the transformations or global transformations directly, run updateGlobalBoneTransformations or set valid to false.
+class FrameKey {
+public:
+    //False if there is no such call, or if the bone transformations have been changed otherwise since,
+    //for instance by SkeletalAnimationModel::setBoneTransformation or SkeletalAnimationModel::updateGlobalBoneTransformations
+    bool valid=false;
+    bool baked=false;
+    unsigned int animationId=0;
+    double time=0.0;
+    bool loop=true;
+    //Only used if baked
+    bool interpolate=true;
+    //True if the frame was changed by overrideBones, so that it is never skipped. The next frame is still updated incrementally.
+    bool overridden=false;
+
+    FrameKey() {}
+    FrameKey(bool baked, unsigned int animationId, double time, bool loop, bool interpolate=true): 
+            valid(true), baked(baked), animationId(animationId), time(time), loop(loop), interpolate(interpolate) {}
+
+    bool operator==(const FrameKey& frameKey) const {
+        return valid && frameKey.valid && !overridden && !frameKey.overridden && baked==frameKey.baked && animationId==frameKey.animationId && time==frameKey.time && 
+               loop==frameKey.loop && (!baked || interpolate==frameKey.interpolate);
+    }
+};
+
+//Animation state of one instance of a SkeletalAnimationModel, containing only the bone matrices.
+//The model itself (meshes, bone weights, animations and materials) is then shared between the instances.
+//Create with SkeletalAnimationModel::createPose, and use with the SkeletalAnimationModel functions taking a Pose.
+class Pose {
+public:
+    //Bone::transformation and Bone::globalTransformation for each bone
+    std::vector<aiMatrix4x4> transformations;
+    std::vector<aiMatrix4x4> globalTransformations;
+
+    //Key cursors per animation and channel, see Animation::interpolate
+    std::vector<std::vector<Animation::ChannelCursor> > channelCursors;
+
+    //The scale, rotation and position of each bone in the last frame, before the boneOverrides
+    LocalPose localPose;
+    //See SkeletalAnimationModel::createFrame taking overrideBones
+    BoneOverrides boneOverrides;
+
+    //Nonzero for the bones changed by SkeletalAnimationModel::setBoneTransformation since the global transformations were updated,
+    //and the lowest of their boneIds. See SkeletalAnimationModel::updateDirtyBoneTransformations.
+    std::vector<unsigned char> dirtyBones;
+    unsigned int firstDirtyBoneId=std::numeric_limits<unsigned int>::max();
+
+    //See FrameKey
+    FrameKey frameKey;
+};
+
+template<class MaterialType=Material, class MeshType=MeshExtended>
+class SkeletalAnimationModel : public Model<MaterialType, MeshType> {
+public:
+    //The allocator of the meshes, bone weights and animations, see BasicMeshExtended
+    typedef typename Model<MaterialType, MeshType>::allocator_type allocator_type;
+    typedef BasicAnimation<allocator_type> AnimationType;
+
+    class MeshFrame {
+    public:
+        std::vector<aiVector3D> vertices;
+        std::vector<aiVector3D> normals;
+
+        const MeshType& mesh;
+
+        //If true, getMeshFrame skips skinning a reused MeshFrame if none of its bones have moved since it was last skinned.
+        //Only set it if vertices and normals are not changed by the caller, who must otherwise set skinned to false after changing them.
+        //Set for the mesh frames owned by FrameJob and drawFrame.
+        bool reuseIfUnchanged=false;
+
+        //Global transformations of the bones in mesh.boneWeights, and the bone influences, the frame was skinned with, see reuseIfUnchanged.
+        //Set skinned to false to skin it again anyway.
+        bool skinned=false;
+        std::vector<aiMatrix4x4> boneTransformations;
+        const AllocatorVector<float, allocator_type>* boneInfluenceWeights=nullptr;
+        unsigned int maxBoneInfluences=4;
+        bool dualQuaternion=false;
+        
+        MeshFrame(const MeshType& mesh): vertices(mesh.vertices.size()), normals(mesh.normals.size()), mesh(mesh) {}
+    };
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //A mesh skinned once into a vertex buffer object, to be drawn any number of times, for instance for the main view, 
+    //the shadow maps and reflections, without skinning or uploading the vertices again for each pass. See getMeshFrame taking a BufferFrame.
+    //The vertex buffer is kept between frames, in the layout of vertexFormat.
+    class BufferFrame {
+    public:
+        GLBuffer vertexBuffer;
+        size_t bufferSize=0;
+        VertexFormat vertexFormat=VertexFormat(false, true);
+
+        const MeshType& mesh;
+
+        BufferFrame(const MeshType& mesh): mesh(mesh) {}
+    };
+#endif
+
+    //Level of detail for distant instances, see addLod and getLod
+    class Lod {
+    public:
+        //Instances at or beyond this distance use this level of detail
+        double distance;
+        //Bone influences per vertex when skinning on the CPU, from 1 to 4. Not applied when skinning on the GPU (see gpuSkinning), 
+        //where the meshes are always skinned with their 4 bone influences, and only the simplified meshes and updateInterval apply.
+        unsigned int maxBoneInfluences;
+        //FrameJobs using this level of detail are updated every updateInterval calls to createFrames, and otherwise keep their previous frame
+        unsigned int updateInterval;
+
+        //Simplified meshes with the bone ids of this model, or empty to use SkeletalAnimationModel::meshes
+        AllocatorVector<MeshType, allocator_type> meshes;
+        //Bone influence weights per mesh, renormalized over the first maxBoneInfluences influences of each vertex.
+        //Empty for meshes with at most maxBoneInfluences bone weights per vertex, which are skinned with their own bone influence weights,
+        //and only the first maxBoneWeightsPerVertex influences of each vertex.
+        std::vector<AllocatorVector<float, allocator_type> > boneInfluenceWeights;
+
+        explicit Lod(const allocator_type& allocator=allocator_type()): meshes(allocator) {}
+    };
+
+    //Animation frame of one model instance to be created by createFrames
+    class FrameJob {
+    public:
+        //The model may be shared between many FrameJobs, since each FrameJob has its own pose
+        const SkeletalAnimationModel* model;
+        Pose pose;
+        unsigned int animationId;
+        double time;
+        bool loop;
+
+        //Level of detail, where 0 is full detail and lod>0 is model->lods[lod-1], see SkeletalAnimationModel::getLod
+        unsigned int lod=0;
+        //Calls to createFrames since the frame was last created, see Lod::updateInterval
+        unsigned int framesSinceUpdate=std::numeric_limits<unsigned int>::max();
+
+        //The created mesh frames, one per mesh in model->getLodMeshes(lod). Not used if model->gpuSkinning is true.
+        //Kept between calls to createFrames to avoid allocations
+        std::vector<MeshFrame> meshFrames;
+
+        //Placement of the instance in the space of the frustum given to createFrames, only used for culling
+        aiMatrix4x4 worldTransformation;
+        //Set by createFrames given a frustum: nonzero for each mesh in model->getLodMeshes(lod) that intersects the frustum,
+        //and visible if any of them does. Meshes outside the frustum are neither skinned nor drawn. Empty if all the meshes are visible.
+        std::vector<unsigned char> visibleMeshes;
+        bool visible=true;
+
+        FrameJob(const SkeletalAnimationModel& model, unsigned int animationId=0, double time=0.0, bool loop=true): 
+                model(&model), pose(model.createPose()), animationId(animationId), time(time), loop(loop) {}
+
+#ifndef SKELETAL_ANIMATION_MODEL_NO_GL
+        //Draws the frame created by createFrames, except the meshes outside the frustum, see visibleMeshes. 
+        //Run on the thread with the OpenGL context. When skinning on the GPU, the meshes of the level of detail 
+        //are drawn with all their bone influences, see Lod::maxBoneInfluences.
+        void draw() const {
+            if(!visible)
+                return;
+            if(model->gpuSkinning) {
+                const auto& meshes=model->getLodMeshes(lod);
+                for(unsigned int cm=0;cm<meshes.size();cm++) {
+                    if(visibleMeshes.empty() || visibleMeshes[cm])
+                        model->drawMeshFrame(pose, meshes[cm]);
+                }
+            }
+            else {
+                for(unsigned int cm=0;cm<meshFrames.size();cm++) {
+                    if(visibleMeshes.empty() || visibleMeshes[cm])
+                        model->drawMeshFrame(meshFrames[cm]);
+                }
+            }
+        }
+#endif
+    };
+    
+private:
+    //Per-thread arena for the scratch buffers of skinning and drawing, see LocalArenaScope. Not synchronized, since it is thread_local.
+    //Keeps its blocks between frames, so these buffers are not allocated every frame.
+    static LocalArena& scratchArena() {
+        static thread_local LocalArena arena(1<<16);
+        return arena;
+    }
+
+    //Add bone if it does not yet exist, and return boneId
+    unsigned int getBoneId(const aiNode* node) {
+        auto result=boneName2boneId.emplace(node->mName.data, bones.size());
+        if(result.second) {
+            bones.emplace_back();
+            bones.back().transformation=node->mTransformation;
+            boneNames.emplace_back(node->mName.data);
+        }
+        return result.first->second;
+    }
+
+    //Adds node and its descendants to nodes by name, keeping the first node found depth-first as aiNode::FindNode does
+    static void addNodes(const aiNode* node, std::unordered_map<std::string, const aiNode*>& nodes) {
+        nodes.emplace(node->mName.data, node);
+        for(unsigned int cc=0;cc<node->mNumChildren;cc++)
+            addNodes(node->mChildren[cc], nodes);
+    }
+
+    //Throws std::runtime_error if the node is not found
+    static const aiNode* findNode(const std::unordered_map<std::string, const aiNode*>& nodes, const aiString& name) {
+        auto it=nodes.find(name.data);
+        if(it==nodes.end())
+            throw std::runtime_error(std::string("SkeletalAnimationModel::read: node not found: ")+name.data);
+        return it->second;
+    }
+
+    //Reorder the bones so that parent bones come before their children, and update all the boneIds
+    void sortBones() {
+        std::vector<unsigned int> depths(bones.size(), 0);
+        for(unsigned int cb=0;cb<bones.size();cb++) {
+            unsigned int boneId=cb;
+            while(bones[boneId].hasParentBoneId) {
+                boneId=bones[boneId].parentBoneId;
+                depths[cb]++;
+            }
+        }
+
+        std::vector<unsigned int> newBoneId2oldBoneId(bones.size());
+        std::iota(newBoneId2oldBoneId.begin(), newBoneId2oldBoneId.end(), 0);
+        std::stable_sort(newBoneId2oldBoneId.begin(), newBoneId2oldBoneId.end(), [&depths](unsigned int a, unsigned int b) {
+            return depths[a]<depths[b];
+        });
+        std::vector<unsigned int> oldBoneId2newBoneId(bones.size());
+        for(unsigned int cb=0;cb<bones.size();cb++)
+            oldBoneId2newBoneId[newBoneId2oldBoneId[cb]]=cb;
+
+        std::vector<Bone> sortedBones;
+        sortedBones.reserve(bones.size());
+        for(unsigned int cb=0;cb<bones.size();cb++) {
+            sortedBones.emplace_back(bones[newBoneId2oldBoneId[cb]]);
+            if(sortedBones[cb].hasParentBoneId)
+                sortedBones[cb].parentBoneId=oldBoneId2newBoneId[sortedBones[cb].parentBoneId];
+        }
+        bones=std::move(sortedBones);
+
+        for(auto& animation: animations) {
+            for(auto& channel: animation.channels)
+                channel.boneId=oldBoneId2newBoneId[channel.boneId];
+        }
+        for(auto& mesh: this->meshes) {
+            for(auto& boneWeights: mesh.boneWeights)
+                boneWeights.boneId=oldBoneId2newBoneId[boneWeights.boneId];
+        }
+        for(auto& p: boneName2boneId)
+            p.second=oldBoneId2newBoneId[p.second];
+        std::vector<std::string> sortedBoneNames(boneNames.size());
+        for(unsigned int cb=0;cb<boneNames.size();cb++)
+            sortedBoneNames[oldBoneId2newBoneId[cb]]=std::move(boneNames[cb]);
+        boneNames=std::move(sortedBoneNames);
+    }
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    std::shared_ptr<SkinningShader> skinningShader;
+    std::shared_ptr<SkinningShader> instancedSkinningShader;
+    std::shared_ptr<SkinningShader> feedbackSkinningShader;
+    std::shared_ptr<BonePaletteTexture> bonePaletteTexture;
+#endif
+
+#ifndef SKELETAL_ANIMATION_MODEL_NO_GL
+    //Mesh frames reused by drawFrame
+    std::vector<MeshFrame> meshFrames;
+
+#endif
+
+    //Find the 4 largest bone weights of each vertex, renormalized if some weights were dropped, see MeshExtended::boneInfluenceIds
+    void createBoneInfluences(MeshType& mesh) {
+        mesh.boneInfluenceIds.assign(mesh.vertices.size()*4, 0);
+        mesh.boneInfluenceWeights.assign(mesh.vertices.size()*4, 0.0);
+        std::vector<unsigned int> numBoneWeights(mesh.vertices.size(), 0);
+
+        for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++) {
+            for(auto& weight: mesh.boneWeights[cb].weights) {
+                numBoneWeights[weight.mVertexId]++;
+                uint16_t* ids=&mesh.boneInfluenceIds[weight.mVertexId*4];
+                float* weights=&mesh.boneInfluenceWeights[weight.mVertexId*4];
+                for(unsigned int c=0;c<4;c++) {
+                    if(weight.mWeight>weights[c]) {
+                        for(unsigned int c2=3;c2>c;c2--) {
+                            ids[c2]=ids[c2-1];
+                            weights[c2]=weights[c2-1];
+                        }
+                        ids[c]=cb;
+                        weights[c]=weight.mWeight;
+                        break;
+                    }
+                }
+            }
+        }
+        mesh.maxBoneWeightsPerVertex=0;
+        for(auto n: numBoneWeights)
+            mesh.maxBoneWeightsPerVertex=std::max(mesh.maxBoneWeightsPerVertex, n);
+
+        //Renormalize the kept weights if some were dropped. Otherwise they are kept as read, as boneWeights.
+        if(mesh.maxBoneWeightsPerVertex>4) {
+            for(unsigned int cv=0;cv<mesh.vertices.size();cv++) {
+                float* weights=&mesh.boneInfluenceWeights[cv*4];
+                float sum=weights[0]+weights[1]+weights[2]+weights[3];
+                if(sum>0.0) {
+                    for(unsigned int c=0;c<4;c++)
+                        weights[c]/=sum;
+                }
+            }
+        }
+    }
+
+    //Create the bind-pose bounding box of each bone of the mesh, see BoneWeights::boundingBox.
+    //Run after createBoneInfluences.
+    void createBoneBoundingBoxes(MeshType& mesh) {
+        for(auto& boneWeights: mesh.boneWeights) {
+            boneWeights.boundingBox=BoundingBox();
+            for(auto& weight: boneWeights.weights) {
+                if(weight.mWeight>0.0)
+                    boneWeights.boundingBox.add(boneWeights.offsetMatrix*mesh.vertices[weight.mVertexId]);
+            }
+        }
+        mesh.unweightedVertices=false;
+        for(unsigned int cv=0;cv<mesh.vertices.size();cv++) {
+            if(mesh.boneInfluenceWeights[cv*4]==0.0) {
+                mesh.unweightedVertices=true;
+                break;
+            }
+        }
+    }
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //Upload bind-pose vertices and bone influences, and the index buffer if not already uploaded
+    void createSkinningBuffers(MeshType& mesh) {
+        mesh.skinningVertexFormat=VertexFormat(this->compactVertices, !mesh.textureCoords.empty(), true);
+        const auto& format=mesh.skinningVertexFormat;
+        std::vector<unsigned char> vertices(mesh.vertices.size()*format.size);
+        for(unsigned int cv=0;cv<mesh.vertices.size();cv++) {
+            unsigned char* vertex=&vertices[cv*format.size];
+            this->writeVertex(format, mesh, cv, vertex);
+            if(format.compact) {
+                GLubyte boneIds[4];
+                GLushort boneWeights[4];
+                for(unsigned int c=0;c<4;c++) {
+                    boneIds[c]=mesh.boneInfluenceIds[cv*4+c];
+                    boneWeights[c]=std::round(mesh.boneInfluenceWeights[cv*4+c]*65535.0f);
+                }
+                std::memcpy(vertex+format.boneIdsOffset, boneIds, sizeof(boneIds));
+                std::memcpy(vertex+format.boneWeightsOffset, boneWeights, sizeof(boneWeights));
+            }
+            else {
+                GLfloat boneIds[4];
+                GLfloat boneWeights[4];
+                for(unsigned int c=0;c<4;c++) {
+                    boneIds[c]=mesh.boneInfluenceIds[cv*4+c];
+                    boneWeights[c]=mesh.boneInfluenceWeights[cv*4+c];
+                }
+                std::memcpy(vertex+format.boneIdsOffset, boneIds, sizeof(boneIds));
+                std::memcpy(vertex+format.boneWeightsOffset, boneWeights, sizeof(boneWeights));
+            }
+        }
+
+        mesh.skinningVertexBuffer.create(GL_ARRAY_BUFFER, vertices);
+        if(!mesh.indexBuffer)
+            this->createIndexBuffer(mesh);
+    }
+
+    //Create the skinning shader, and upload the meshes that can be skinned on the GPU
+    void createSkinningBuffers() {
+        if(!skinningShader || skinningShader->dualQuaternion!=dualQuaternionSkinning)
+            skinningShader=std::make_shared<SkinningShader>(false, dualQuaternionSkinning);
+        if(gpuInstancing && (!instancedSkinningShader || instancedSkinningShader->dualQuaternion!=dualQuaternionSkinning)) {
+            instancedSkinningShader=std::make_shared<SkinningShader>(true, dualQuaternionSkinning);
+            if(!bonePaletteTexture)
+                bonePaletteTexture=std::make_shared<BonePaletteTexture>();
+        }
+        if(transformFeedbackSkinning && (!feedbackSkinningShader || feedbackSkinningShader->dualQuaternion!=dualQuaternionSkinning))
+            feedbackSkinningShader=std::make_shared<SkinningShader>(false, dualQuaternionSkinning, true);
+        for(auto& mesh: this->meshes) {
+            if(mesh.boneWeights.size()<=SKINNING_SHADER_MAX_BONES)
+                createSkinningBuffers(mesh);
+            //Meshes skinned on the CPU are also drawn from buffer frames, see BufferFrame
+            else if(transformFeedbackSkinning && !mesh.indexBuffer)
+                this->createIndexBuffer(mesh);
+        }
+    }
+#endif
+
+    //Samples the channels of the given animation, and passes the boneId and new scale, rotation and position of each channel to setTransformation
+    template<class SetTransformation>
+    void sampleAnimation(unsigned int animationId, double time, bool loop, std::vector<std::vector<Animation::ChannelCursor> >& channelCursors, 
+                         const SetTransformation& setTransformation) const {
+        SKELETAL_ANIMATION_MODEL_TIME(SAMPLING);
+        if(animationId<animations.size()) {
+            const auto& animation=animations[animationId];
+            if(channelCursors.size()!=animations.size())
+                channelCursors.resize(animations.size());
+            auto& cursors=channelCursors[animationId];
+            if(cursors.size()!=animation.channels.size())
+                cursors.resize(animation.channels.size());
+
+            for(unsigned int cc=0;cc<animation.channels.size();cc++) {
+                const auto& channel=animation.channels[cc];
+                aiVector3D scale;
+                aiQuaternion rotation;
+                aiVector3D position;
+                animation.interpolate(channel, time, loop, cursors[cc], scale, rotation, position);
+                setTransformation(channel.boneId, scale, rotation, position);
+            }
+        }
+    }
+
+    //Creates the frame of newFrameKey, incrementally unless the previous frame was baked or the bone transformations were changed otherwise
+    template<class OverrideBones>
+    void createFrameFromKey(const FrameKey& newFrameKey, const OverrideBones& overrideBones) {
+        //The global transformations are up to date with the transformations of the previous frame unless it was baked
+        bool incremental=frameKey.valid && !frameKey.baked;
+        sampleFrame(newFrameKey.animationId, newFrameKey.time, newFrameKey.loop, channelCursors, localPose, boneOverrides, 
+                    dirtyBones, firstDirtyBoneId, incremental, [this](unsigned int boneId) -> aiMatrix4x4& {
+            return bones[boneId].transformation;
+        }, overrideBones);
+        if(incremental)
+            updateDirtyBoneTransformations();
+        else
+            updateGlobalBoneTransformations();
+        frameKey=newFrameKey;
+    }
+
+    //Same as above, for the given pose
+    template<class OverrideBones>
+    void createFrameFromKey(Pose& pose, const FrameKey& newFrameKey, const OverrideBones& overrideBones) const {
+        bool incremental=pose.frameKey.valid && !pose.frameKey.baked;
+        sampleFrame(newFrameKey.animationId, newFrameKey.time, newFrameKey.loop, pose.channelCursors, pose.localPose, pose.boneOverrides, 
+                    pose.dirtyBones, pose.firstDirtyBoneId, incremental, [&pose](unsigned int boneId) -> aiMatrix4x4& {
+            return pose.transformations[boneId];
+        }, overrideBones);
+        if(incremental)
+            updateDirtyBoneTransformations(pose);
+        else
+            updateGlobalBoneTransformations(pose);
+        pose.frameKey=newFrameKey;
+    }
+
+    //Starts localPose from restPose if it does not have one entry per bone, for instance in a new Pose
+    void initLocalPose(LocalPose& localPose) const {
+        if(localPose.scales.size()!=bones.size() || localPose.rotations.size()!=bones.size() || localPose.positions.size()!=bones.size())
+            localPose=restPose;
+    }
+
+    void setLocalPose(LocalPose& localPose, unsigned int boneId, const aiVector3D& scale, const aiQuaternion& rotation, const aiVector3D& position) const {
+        initLocalPose(localPose);
+        localPose.scales[boneId]=scale;
+        localPose.rotations[boneId]=rotation;
+        localPose.positions[boneId]=position;
+    }
+
+    //Samples the given animation into localPose, and sets the matrix returned by transformation(boneId) of the bones with channels.
+    //The bones overridden in the previous frame are restored from localPose. Then overrideBones is called with boneOverrides, 
+    //and the matrices of the bones it overrides are composed from the overrides.
+    //If incremental, only the bones with changed matrices are marked dirty, see updateDirtyBoneTransformations.
+    template<class Transformation, class OverrideBones>
+    void sampleFrame(unsigned int animationId, double time, bool loop, std::vector<std::vector<Animation::ChannelCursor> >& channelCursors, 
+                     LocalPose& localPose, BoneOverrides& boneOverrides, std::vector<unsigned char>& dirtyBones, unsigned int& firstDirtyBoneId,
+                     bool incremental, const Transformation& transformation, const OverrideBones& overrideBones) const {
+        initLocalPose(localPose);
+        auto setTransformation=[this, &dirtyBones, &firstDirtyBoneId, incremental, &transformation](unsigned int boneId, const aiMatrix4x4& newTransformation) {
+            aiMatrix4x4& boneTransformation=transformation(boneId);
+            if(!incremental)
+                boneTransformation=newTransformation;
+            else if(boneTransformation!=newTransformation) {
+                boneTransformation=newTransformation;
+                markDirtyBone(dirtyBones, firstDirtyBoneId, boneId);
+            }
+        };
+        sampleAnimation(animationId, time, loop, channelCursors, 
+                        [&localPose, &setTransformation](unsigned int boneId, const aiVector3D& scale, const aiQuaternion& rotation, const aiVector3D& position) {
+            localPose.scales[boneId]=scale;
+            localPose.rotations[boneId]=rotation;
+            localPose.positions[boneId]=position;
+            setTransformation(boneId, aiMatrix4x4Compose(scale, rotation, position));
+        });
+
+        for(auto& boneOverride: boneOverrides.overrides) {
+            unsigned int boneId=boneOverride.boneId;
+            setTransformation(boneId, aiMatrix4x4Compose(localPose.scales[boneId], localPose.rotations[boneId], localPose.positions[boneId]));
+        }
+        boneOverrides.overrides.clear();
+        boneOverrides.localPose=&localPose;
+        overrideBones(boneOverrides);
+        for(auto& boneOverride: boneOverrides.overrides)
+            setTransformation(boneOverride.boneId, aiMatrix4x4Compose(boneOverride.scale, boneOverride.rotation, boneOverride.position));
+    }
+
+    //Composes the matrix returned by transformation(boneId) of every bone from localPose, after overrideBones is called with boneOverrides
+    template<class Transformation, class OverrideBones>
+    void composeLocalPose(const LocalPose& localPose, BoneOverrides& boneOverrides, const Transformation& transformation, 
+                          const OverrideBones& overrideBones) const {
+        boneOverrides.overrides.clear();
+        boneOverrides.localPose=&localPose;
+        overrideBones(boneOverrides);
+        for(unsigned int cb=0;cb<bones.size();cb++)
+            transformation(cb)=aiMatrix4x4Compose(localPose.scales[cb], localPose.rotations[cb], localPose.positions[cb]);
+        for(auto& boneOverride: boneOverrides.overrides)
+            transformation(boneOverride.boneId)=aiMatrix4x4Compose(boneOverride.scale, boneOverride.rotation, boneOverride.position);
+    }
+
+    //Samples each layer once, blending the channels directly into localPose, which starts from restPose
+    void blendLayers(const std::vector<AnimationLayer>& layers, std::vector<std::vector<Animation::ChannelCursor> >& channelCursors, 
+                     LocalPose& localPose) const {
+        localPose.scales.assign(restPose.scales.begin(), restPose.scales.end());
+        localPose.rotations.assign(restPose.rotations.begin(), restPose.rotations.end());
+        localPose.positions.assign(restPose.positions.begin(), restPose.positions.end());
+
+        for(auto& layer: layers) {
+            if(layer.weight<=0.0)
+                continue;
+            sampleAnimation(layer.animationId, layer.time, layer.loop, channelCursors, 
+                            [&layer, &localPose](unsigned int boneId, const aiVector3D& scale, const aiQuaternion& rotation, const aiVector3D& position) {
+                float weight=layer.weight;
+                if(layer.boneMask)
+                    weight*=boneId<layer.boneMask->size() ? (*layer.boneMask)[boneId] : 0.0;
+                if(weight>=1.0) {
+                    localPose.scales[boneId]=scale;
+                    localPose.rotations[boneId]=rotation;
+                    localPose.positions[boneId]=position;
+                }
+                else if(weight>0.0) {
+                    localPose.scales[boneId]+=(scale-localPose.scales[boneId])*weight;
+                    aiQuaternion::Interpolate(localPose.rotations[boneId], aiQuaternion(localPose.rotations[boneId]), rotation, weight);
+                    localPose.positions[boneId]+=(position-localPose.positions[boneId])*weight;
+                }
+            });
+        }
+    }
+
+    //Decomposes the bone transformations of the model as read, see restPose
+    void createRestPose() {
+        restPose.scales.resize(bones.size());
+        restPose.rotations.resize(bones.size());
+        restPose.positions.resize(bones.size());
+        for(unsigned int cb=0;cb<bones.size();cb++)
+            bones[cb].transformation.Decompose(restPose.scales[cb], restPose.rotations[cb], restPose.positions[cb]);
+    }
+
+    //Same as Pose::localPose and Pose::boneOverrides, for the model itself
+    LocalPose localPose;
+    BoneOverrides boneOverrides;
+
+    //Same as Pose::dirtyBones, Pose::firstDirtyBoneId and Pose::frameKey, for the model itself
+    std::vector<unsigned char> dirtyBones;
+    unsigned int firstDirtyBoneId=std::numeric_limits<unsigned int>::max();
+    FrameKey frameKey;
+
+    //Returns true if meshFrame.reuseIfUnchanged is set and meshFrame was skinned with the given bone influences and the current 
+    //global transformations of its bones. Otherwise they are stored in meshFrame, which is then skinned again by the caller.
+    template<class GlobalTransformation>
+    bool isMeshFrameCurrent(const GlobalTransformation& globalTransformation, MeshFrame& meshFrame, 
+                            const AllocatorVector<float, allocator_type>* boneInfluenceWeights, unsigned int maxBoneInfluences) const {
+        if(!meshFrame.reuseIfUnchanged)
+            return false;
+        const MeshType& mesh=meshFrame.mesh;
+        bool current=meshFrame.skinned && meshFrame.vertices.size()==mesh.vertices.size() && meshFrame.normals.size()==mesh.normals.size() &&
+                     meshFrame.boneInfluenceWeights==boneInfluenceWeights && meshFrame.maxBoneInfluences==maxBoneInfluences &&
+                     meshFrame.dualQuaternion==dualQuaternionSkinning && meshFrame.boneTransformations.size()==mesh.boneWeights.size();
+        meshFrame.boneTransformations.resize(mesh.boneWeights.size());
+        for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++) {
+            const aiMatrix4x4& transformation=globalTransformation(mesh.boneWeights[cb].boneId);
+            if(!current || meshFrame.boneTransformations[cb]!=transformation) {
+                current=false;
+                meshFrame.boneTransformations[cb]=transformation;
+            }
+        }
+        meshFrame.skinned=true;
+        meshFrame.boneInfluenceWeights=boneInfluenceWeights;
+        meshFrame.maxBoneInfluences=maxBoneInfluences;
+        meshFrame.dualQuaternion=dualQuaternionSkinning;
+        return current;
+    }
+
+    //Marks boneId as changed, see setBoneTransformation
+    void markDirtyBone(std::vector<unsigned char>& dirtyBones, unsigned int& firstDirtyBoneId, unsigned int boneId) const {
+        if(dirtyBones.size()!=bones.size())
+            dirtyBones.assign(bones.size(), 0);
+        dirtyBones[boneId]=1;
+        firstDirtyBoneId=std::min(firstDirtyBoneId, boneId);
+    }
+
+    //Sets the transformation of each bone from its global transformation and the inverse of its parent's, 
+    //since a baked frame only updates the global transformations, see setBoneTransformation
+    void recoverBakedTransformations() {
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, bones.size());
+        for(auto& bone: bones) {
+            if(bone.hasParentBoneId) {
+                aiMatrix4x4 parentInverse=bones[bone.parentBoneId].globalTransformation;
+                bone.transformation=parentInverse.Inverse()*bone.globalTransformation;
+            }
+            else
+                bone.transformation=bone.globalTransformation;
+        }
+    }
+
+    //Same as above, for the given pose
+    void recoverBakedTransformations(Pose& pose) const {
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, bones.size());
+        for(unsigned int cb=0;cb<bones.size();cb++) {
+            if(bones[cb].hasParentBoneId) {
+                aiMatrix4x4 parentInverse=pose.globalTransformations[bones[cb].parentBoneId];
+                pose.transformations[cb]=parentInverse.Inverse()*pose.globalTransformations[cb];
+            }
+            else
+                pose.transformations[cb]=pose.globalTransformations[cb];
+        }
+    }
+
+    static void clearDirtyBones(std::vector<unsigned char>& dirtyBones, unsigned int& firstDirtyBoneId) {
+        if(firstDirtyBoneId<dirtyBones.size())
+            std::fill(dirtyBones.begin()+firstDirtyBoneId, dirtyBones.end(), 0);
+        firstDirtyBoneId=std::numeric_limits<unsigned int>::max();
+    }
+
+    //Looks up the baked animation at the given time, and passes the boneId and global transformation of each bone to setGlobalTransformation.
+    //Returns false if the animation is not baked.
+    template<class SetGlobalTransformation>
+    bool sampleBakedAnimation(unsigned int animationId, double time, bool loop, bool interpolate, 
+                              const SetGlobalTransformation& setGlobalTransformation) const {
+        if(animationId>=bakedAnimations.size() || bakedAnimations[animationId].numFrames()==0 || bakedAnimations[animationId].numBones!=bones.size())
+            return false;
+        SKELETAL_ANIMATION_MODEL_TIME(SAMPLING);
+        const auto& bakedAnimation=bakedAnimations[animationId];
+
+        unsigned int numFrames=bakedAnimation.numFrames();
+        if(loop)
+            time=fmod(time, bakedAnimation.duration);
+        double frame=std::max(std::min(time, bakedAnimation.duration)*bakedAnimation.framesPerSecond, 0.0);
+        unsigned int frameBefore=std::min(static_cast<unsigned int>(frame), numFrames);
+        //When looping, the last frame is followed by the first frame instead of the frame at duration
+        unsigned int frameAfter=loop ? (frameBefore+1)%numFrames : std::min(frameBefore+1, numFrames);
+        float factor=frame-frameBefore;
+
+        const AffineTransformation* before=&bakedAnimation.frames[frameBefore*bones.size()];
+        const AffineTransformation* after=&bakedAnimation.frames[frameAfter*bones.size()];
+        for(unsigned int cb=0;cb<bones.size();cb++) {
+            if(interpolate && factor>0.0)
+                setGlobalTransformation(cb, before[cb].interpolate(after[cb], factor));
+            else
+                setGlobalTransformation(cb, before[cb]);
+        }
+        return true;
+    }
+
+    //Returns the bounding box of the given mesh skinned with linear blend skinning, where globalTransformation(boneId) returns the global transformation 
+    //matrix of the bone. Each skinned vertex is a weighted average of the vertex transformed by its bones, 
+    //and is thus within the bind-pose bounding boxes of its bones transformed by their global transformations.
+    template<class GlobalTransformation>
+    BoundingBox getSkinnedBoundingBox(const GlobalTransformation& globalTransformation, const MeshType& mesh) const {
+        BoundingBox boundingBox;
+        for(auto& boneWeights: mesh.boneWeights)
+            boundingBox.add(boneWeights.boundingBox.transform(globalTransformation(boneWeights.boneId)));
+        if(mesh.unweightedVertices || mesh.boneWeights.empty())
+            boundingBox.add(aiVector3D(0.0, 0.0, 0.0));
+        return boundingBox;
+    }
+
+    //Skins the given mesh, where globalTransformation(boneId) returns the global transformation matrix of the bone.
+    //If given, boneInfluenceWeights, which may be mesh.boneInfluenceWeights, is used with only the first numBoneInfluences weights of each vertex. See Lod.
+    template<class GlobalTransformation>
+    void skinMesh(const GlobalTransformation& globalTransformation, const MeshType& mesh, aiVector3D* vertices, aiVector3D* normals,
+                  const AllocatorVector<float, allocator_type>* boneInfluenceWeights=nullptr, unsigned int numBoneInfluences=4) const {
+        SKELETAL_ANIMATION_MODEL_TIME(SKINNING);
+        SKELETAL_ANIMATION_MODEL_COUNT(VERTICES_SKINNED, mesh.vertices.size());
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, mesh.boneWeights.size());
+        if(!boneInfluenceWeights || boneInfluenceWeights->size()!=mesh.vertices.size()*4) {
+            boneInfluenceWeights=&mesh.boneInfluenceWeights;
+            numBoneInfluences=4;
+        }
+        if((mesh.maxBoneWeightsPerVertex<=4 || boneInfluenceWeights!=&mesh.boneInfluenceWeights) && 
+           mesh.boneInfluenceWeights.size()==mesh.vertices.size()*4) {
+            //Bone palette for this mesh, in the same order as mesh.boneWeights. 
+            //Allocated from the scratch arena of the thread so that skinning does not allocate every frame.
+            LocalArenaScope scratch(scratchArena());
+            AffineTransformation* palette=scratch.allocate<AffineTransformation>(std::max<size_t>(mesh.boneWeights.size(), 1));
+            for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++)
+                palette[cb]=AffineTransformation(globalTransformation(mesh.boneWeights[cb].boneId))*mesh.boneWeights[cb].offsetTransformation;
+            //Vertices without bone weights end up in origo, as when accumulating boneWeights
+            if(mesh.boneWeights.size()==0)
+                std::fill(palette[0].columns, palette[0].columns+16, 0.0);
+
+            if(dualQuaternionSkinning) {
+                DualQuaternion* dualQuaternionPalette=scratch.allocate<DualQuaternion>(std::max<size_t>(mesh.boneWeights.size(), 1));
+                for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++)
+                    dualQuaternionPalette[cb]=DualQuaternion(palette[cb]);
+                if(mesh.boneWeights.size()==0)
+                    std::fill(dualQuaternionPalette[0].real, dualQuaternionPalette[0].real+8, 0.0);
+
+                static_assert(sizeof(DualQuaternion)==8*sizeof(float), "DualQuaternion must be 8 floats");
+                skinBoneInfluencesDualQuaternion(dualQuaternionPalette[0].real, mesh.boneInfluenceIds.data(), boneInfluenceWeights->data(),
+                                                 mesh.vertices.data(), mesh.normals.data(), mesh.vertices.size(), vertices, normals, numBoneInfluences);
+                return;
+            }
+
+            static_assert(sizeof(AffineTransformation)==16*sizeof(float), "AffineTransformation must be 16 floats");
+            skinBoneInfluences(palette[0].columns, mesh.boneInfluenceIds.data(), boneInfluenceWeights->data(),
+                               mesh.vertices.data(), mesh.normals.data(), mesh.vertices.size(), vertices, normals, numBoneInfluences);
+            return;
+        }
+
+        if(dualQuaternionSkinning) {
+            LocalArenaScope scratch(scratchArena());
+            DualQuaternion* dualQuaternionPalette=scratch.allocate<DualQuaternion>(mesh.boneWeights.size());
+            for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++) {
+                dualQuaternionPalette[cb]=DualQuaternion(AffineTransformation(globalTransformation(mesh.boneWeights[cb].boneId))*
+                                                         mesh.boneWeights[cb].offsetTransformation);
+            }
+
+            //As in skinBoneInfluencesDualQuaternion, the dual quaternions of each vertex are blended in the hemisphere of the one with the largest weight
+            unsigned int* largestWeightIds=scratch.allocate<unsigned int>(mesh.vertices.size());
+            float* largestWeights=scratch.allocate<float>(mesh.vertices.size());
+            for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++) {
+                for(auto& weight: mesh.boneWeights[cb].weights) {
+                    if(weight.mWeight>largestWeights[weight.mVertexId]) {
+                        largestWeights[weight.mVertexId]=weight.mWeight;
+                        largestWeightIds[weight.mVertexId]=cb;
+                    }
+                }
+            }
+
+            DualQuaternion* blended=scratch.allocate<DualQuaternion>(mesh.vertices.size());
+            std::fill(blended->real, blended->real+8*mesh.vertices.size(), 0.0);
+            for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++) {
+                const auto& dualQuaternion=dualQuaternionPalette[cb];
+                for(auto& weight: mesh.boneWeights[cb].weights) {
+                    const auto& largest=dualQuaternionPalette[largestWeightIds[weight.mVertexId]];
+                    float dot=0.0;
+                    for(unsigned int c=0;c<4;c++)
+                        dot+=largest.real[c]*dualQuaternion.real[c];
+                    float vertexWeight=dot<0.0 ? -weight.mWeight : weight.mWeight;
+                    auto& vertexBlend=blended[weight.mVertexId];
+                    for(unsigned int c=0;c<4;c++) {
+                        vertexBlend.real[c]+=vertexWeight*dualQuaternion.real[c];
+                        vertexBlend.dual[c]+=vertexWeight*dualQuaternion.dual[c];
+                    }
+                }
+            }
+            for(unsigned int cv=0;cv<mesh.vertices.size();cv++) {
+                if(blended[cv].normalize()) {
+                    vertices[cv]=blended[cv].transformPoint(mesh.vertices[cv]);
+                    normals[cv]=blended[cv].transformNormal(mesh.normals[cv]);
+                }
+                else {
+                    vertices[cv]=aiVector3D();
+                    normals[cv]=aiVector3D();
+                }
+            }
+            return;
+        }
+
+        std::fill(vertices, vertices+mesh.vertices.size(), aiVector3D());
+        std::fill(normals, normals+mesh.normals.size(), aiVector3D());
+
+        //Calculate new frame vertices and normals
+        for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++) {
+            const auto& boneWeights=mesh.boneWeights[cb];
+
+            AffineTransformation transformation=AffineTransformation(globalTransformation(boneWeights.boneId))*boneWeights.offsetTransformation;
+
+            for(auto& weight: boneWeights.weights) {
+                vertices[weight.mVertexId]+=weight.mWeight*transformation.transformPoint(mesh.vertices[weight.mVertexId]);
+                normals[weight.mVertexId]+=weight.mWeight*transformation.transformNormal(mesh.normals[weight.mVertexId]);
+            }
+        }
+    }
+
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //Draws the given mesh skinned on the GPU, where globalTransformation(boneId) returns the global transformation matrix of the bone
+    template<class GlobalTransformation>
+    void drawSkinnedMesh(const GlobalTransformation& globalTransformation, const MeshType& mesh) const {
+        SKELETAL_ANIMATION_MODEL_TIME(DRAWING);
+        bool texture=bindSkinnedMesh(*skinningShader, mesh);
+        uploadBonePalette(*skinningShader, globalTransformation, mesh);
+
+        glDrawElements(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT, nullptr);
+
+        unbindSkinnedMesh(*skinningShader, mesh, texture);
+    }
+
+    //Sets the bone palette uniform of the bound shader for the given mesh, 
+    //where globalTransformation(boneId) returns the global transformation matrix of the bone
+    template<class GlobalTransformation>
+    void uploadBonePalette(const SkinningShader& shader, const GlobalTransformation& globalTransformation, const MeshType& mesh) const {
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, mesh.boneWeights.size());
+        //Bone matrices for this mesh, in the same order as mesh.boneWeights. Allocated from the scratch arena to avoid allocations.
+        LocalArenaScope scratch(scratchArena());
+        AffineTransformation* boneMatrices=scratch.allocate<AffineTransformation>(mesh.boneWeights.size());
+        for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++)
+            boneMatrices[cb]=AffineTransformation(globalTransformation(mesh.boneWeights[cb].boneId))*mesh.boneWeights[cb].offsetTransformation;
+
+        if(mesh.boneWeights.size()>0) {
+            if(shader.dualQuaternion) {
+                SKELETAL_ANIMATION_MODEL_COUNT(BYTES_UPLOADED, mesh.boneWeights.size()*sizeof(DualQuaternion));
+                DualQuaternion* boneDualQuaternions=scratch.allocate<DualQuaternion>(mesh.boneWeights.size());
+                for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++)
+                    boneDualQuaternions[cb]=DualQuaternion(boneMatrices[cb]);
+                glUniform4fv(shader.boneMatricesLocation, mesh.boneWeights.size()*2, boneDualQuaternions[0].real);
+            }
+            else {
+                SKELETAL_ANIMATION_MODEL_COUNT(BYTES_UPLOADED, mesh.boneWeights.size()*sizeof(AffineTransformation));
+                glUniformMatrix4fv(shader.boneMatricesLocation, mesh.boneWeights.size(), GL_FALSE, boneMatrices[0].columns);
+            }
+        }
+    }
+
+    //Skins the given mesh into bufferFrame.vertexBuffer, where globalTransformation(boneId) returns the global transformation matrix of the bone.
+    //With transform feedback if possible, see transformFeedbackSkinning, and otherwise on the CPU followed by an upload.
+    template<class GlobalTransformation>
+    void skinToBuffer(const GlobalTransformation& globalTransformation, BufferFrame& bufferFrame) const {
+        const MeshType& mesh=bufferFrame.mesh;
+        size_t bufferSize=mesh.vertices.size()*bufferFrame.vertexFormat.size;
+        if(!bufferFrame.vertexBuffer || bufferFrame.bufferSize!=bufferSize) {
+            bufferFrame.vertexBuffer.create(GL_ARRAY_BUFFER, std::vector<unsigned char>(bufferSize), GL_DYNAMIC_COPY);
+            bufferFrame.bufferSize=bufferSize;
+        }
+
+        if(!feedbackSkinningShader || !mesh.skinningVertexBuffer) {
+            LocalArenaScope scratch(scratchArena());
+            aiVector3D* vertices=scratch.allocate<aiVector3D>(mesh.vertices.size());
+            aiVector3D* normals=scratch.allocate<aiVector3D>(mesh.normals.size());
+            skinMesh(globalTransformation, mesh, vertices, normals);
+            const auto& format=bufferFrame.vertexFormat;
+            unsigned char* bufferVertices=scratch.allocate<unsigned char>(bufferSize);
+            for(unsigned int cv=0;cv<mesh.vertices.size();cv++) {
+                unsigned char* vertex=&bufferVertices[cv*format.size];
+                std::memcpy(vertex, &vertices[cv], 3*sizeof(GLfloat));
+                if(cv<mesh.normals.size())
+                    std::memcpy(vertex+format.normalOffset, &normals[cv], 3*sizeof(GLfloat));
+                if(cv<mesh.textureCoords.size())
+                    std::memcpy(vertex+format.textureCoordOffset, &mesh.textureCoords[cv], 2*sizeof(GLfloat));
+            }
+            SKELETAL_ANIMATION_MODEL_COUNT(BYTES_UPLOADED, bufferSize);
+            glBindBuffer(GL_ARRAY_BUFFER, bufferFrame.vertexBuffer.id());
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bufferSize, bufferVertices);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return;
+        }
+
+        SKELETAL_ANIMATION_MODEL_TIME(SKINNING);
+        SKELETAL_ANIMATION_MODEL_COUNT(VERTICES_SKINNED, mesh.vertices.size());
+        const auto& shader=*feedbackSkinningShader;
+        glUseProgram(shader.program);
+        //The texture coordinates are passed through to the buffer frame
+        enableSkinningArrays(shader, mesh, true);
+        uploadBonePalette(shader, globalTransformation, mesh);
+
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, bufferFrame.vertexBuffer.id());
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, mesh.vertices.size());
+        glEndTransformFeedback();
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+        unbindSkinnedMesh(shader, mesh, true);
+    }
+
+    //Draws numInstances of the given mesh skinned on the GPU with one draw call, or a few if the texture buffer is too small,
+    //where globalTransformation(instanceId, boneId) returns the global transformation matrix of the bone in the instance
+    template<class GlobalTransformation>
+    void drawInstancedMesh(const GlobalTransformation& globalTransformation, const aiMatrix4x4* instanceTransformations, size_t numInstances, 
+                           const MeshType& mesh) const {
+        SKELETAL_ANIMATION_MODEL_TIME(DRAWING);
+        size_t numBones=std::max<size_t>(mesh.boneWeights.size(), 1);
+        GLint maxTexels;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        bool dualQuaternion=instancedSkinningShader->dualQuaternion;
+        size_t texelsPerBone=dualQuaternion ? 2 : 4;
+        size_t maxInstances=std::max<size_t>(maxTexels/(numBones*texelsPerBone), 1);
+
+        //Bone palettes of the instances in the same order as mesh.boneWeights, with the instance transformations applied.
+        //Allocated from the scratch arena of the thread so that drawing does not allocate every frame.
+        //The dual quaternions are converted from the bone matrices if the shader skins with dual quaternions.
+        size_t paletteSize=std::min(numInstances, maxInstances)*numBones;
+        LocalArenaScope scratch(scratchArena());
+        AffineTransformation* boneMatrices=scratch.allocate<AffineTransformation>(paletteSize);
+        DualQuaternion* boneDualQuaternions=dualQuaternion ? scratch.allocate<DualQuaternion>(paletteSize) : nullptr;
+        //Vertices without bone weights end up in origo, as when skinning on the CPU
+        if(mesh.boneWeights.size()==0) {
+            std::fill(boneMatrices[0].columns, boneMatrices[0].columns+16*paletteSize, 0.0);
+            if(dualQuaternion)
+                std::fill(boneDualQuaternions[0].real, boneDualQuaternions[0].real+8*paletteSize, 0.0);
+        }
+
+        bool texture=bindSkinnedMesh(*instancedSkinningShader, mesh);
+        glUniform1i(instancedSkinningShader->numBonesLocation, numBones);
+        glUniform1i(instancedSkinningShader->boneMatricesLocation, 1);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, bonePaletteTexture->texture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindBuffer(GL_TEXTURE_BUFFER, bonePaletteTexture->buffer.id());
+
+        for(size_t firstInstance=0;firstInstance<numInstances;firstInstance+=maxInstances) {
+            size_t batchSize=std::min(maxInstances, numInstances-firstInstance);
+            for(size_t ci=0;ci<batchSize;ci++) {
+                AffineTransformation instanceTransformation(instanceTransformations[firstInstance+ci]);
+                for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++) {
+                    boneMatrices[ci*numBones+cb]=instanceTransformation*
+                            AffineTransformation(globalTransformation(firstInstance+ci, mesh.boneWeights[cb].boneId))*mesh.boneWeights[cb].offsetTransformation;
+                    if(dualQuaternion)
+                        boneDualQuaternions[ci*numBones+cb]=DualQuaternion(boneMatrices[ci*numBones+cb]);
+                }
+            }
+            SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, batchSize*mesh.boneWeights.size()*2);
+            if(dualQuaternion) {
+                SKELETAL_ANIMATION_MODEL_COUNT(BYTES_UPLOADED, batchSize*numBones*sizeof(DualQuaternion));
+                glBufferData(GL_TEXTURE_BUFFER, batchSize*numBones*sizeof(DualQuaternion), boneDualQuaternions, GL_STREAM_DRAW);
+            }
+            else {
+                SKELETAL_ANIMATION_MODEL_COUNT(BYTES_UPLOADED, batchSize*numBones*sizeof(AffineTransformation));
+                glBufferData(GL_TEXTURE_BUFFER, batchSize*numBones*sizeof(AffineTransformation), boneMatrices, GL_STREAM_DRAW);
+            }
+            glDrawElementsInstanced(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT, nullptr, batchSize);
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+        unbindSkinnedMesh(*instancedSkinningShader, mesh, texture);
+    }
+
+    //Binds the shader, the material texture and the skinning vertex buffer of the given mesh.
+    //Returns true if the material has a texture, and the mesh texture coordinates.
+    bool bindSkinnedMesh(const SkinningShader& shader, const MeshType& mesh) const {
+        bool texture=false;
+        if(this->materials[mesh.materialId].texture() && !mesh.textureCoords.empty())
+            texture=true;
+
+        glUseProgram(shader.program);
+        glUniform1i(shader.hasTextureLocation, texture);
+        if(texture) {
+            glUniform1i(shader.textureLocation, 0);
+            this->materials[mesh.materialId].bindTexture(aiTextureType_DIFFUSE, 0);
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer.id());
+        enableSkinningArrays(shader, mesh, texture);
+        return texture;
+    }
+
+    //Binds the bind-pose vertices and bone influences of mesh to the attributes of shader
+    void enableSkinningArrays(const SkinningShader& shader, const MeshType& mesh, bool texture) const {
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.skinningVertexBuffer.id());
+        const auto& format=mesh.skinningVertexFormat;
+        format.enableArrays(texture);
+        glEnableVertexAttribArray(shader.boneIdsLocation);
+        glEnableVertexAttribArray(shader.boneWeightsLocation);
+        glVertexAttribPointer(shader.boneIdsLocation, 4, format.compact ? GL_UNSIGNED_BYTE : GL_FLOAT, GL_FALSE, format.size, 
+                              reinterpret_cast<const GLvoid*>(format.boneIdsOffset));
+        glVertexAttribPointer(shader.boneWeightsLocation, 4, format.compact ? GL_UNSIGNED_SHORT : GL_FLOAT, format.compact, format.size, 
+                              reinterpret_cast<const GLvoid*>(format.boneWeightsOffset));
+    }
+
+    void unbindSkinnedMesh(const SkinningShader& shader, const MeshType& mesh, bool texture) const {
+        glDisableVertexAttribArray(shader.boneIdsLocation);
+        glDisableVertexAttribArray(shader.boneWeightsLocation);
+        mesh.skinningVertexFormat.disableArrays(texture);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+    }
+#endif
 
-    unsigned int boneId;
-};
+#ifndef SKELETAL_ANIMATION_MODEL_NO_GL
+    //Draws the instances given instancePose(instanceId), see drawInstances
+    template<class InstancePose>
+    void drawInstancedPoses(const InstancePose& instancePose, const aiMatrix4x4* instanceTransformations, size_t numInstances) const {
+        for(auto& mesh: this->meshes) {
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+            if(instancedSkinningShader && mesh.skinningVertexBuffer) {
+                drawInstancedMesh([&instancePose](size_t instanceId, unsigned int boneId) -> const aiMatrix4x4& {
+                    return instancePose(instanceId).globalTransformations[boneId];
+                }, instanceTransformations, numInstances, mesh);
+                continue;
+            }
+#endif
+            for(size_t ci=0;ci<numInstances;ci++) {
+                glPushMatrix();
+                glMultMatrixf(AffineTransformation(instanceTransformations[ci]).columns);
+                drawMeshFrame(instancePose(ci), mesh);
+                glPopMatrix();
+            }
+        }
+    }
+#endif
 
-class MeshExtended : public Mesh {
-public:
-    std::vector<BoneWeights> boneWeights;
-};
+    //Instances per job in getWorldBoneTransformations
+    static const size_t WORLD_BONE_TRANSFORMATIONS_BATCH_SIZE=64;
+
+    //Writes the world transformations of the given bones of the instances given instancePose(instanceId), see getWorldBoneTransformations
+    template<class InstancePose>
+    void getInstanceBoneTransformations(const InstancePose& instancePose, const aiMatrix4x4* worldTransformations, size_t numInstances,
+                                        const std::vector<unsigned int>& boneIds, std::vector<AffineTransformation>& result, JobSystem* jobSystem) const {
+        for(auto boneId: boneIds) {
+            if(boneId>=bones.size())
+                throw std::runtime_error("SkeletalAnimationModel::getWorldBoneTransformations: invalid boneId");
+        }
+        result.resize(numInstances*boneIds.size());
+        size_t numBatches=(numInstances+WORLD_BONE_TRANSFORMATIONS_BATCH_SIZE-1)/WORLD_BONE_TRANSFORMATIONS_BATCH_SIZE;
+        this->runJobs(jobSystem, numBatches, [&instancePose, worldTransformations, numInstances, &boneIds, &result](size_t batch) {
+            size_t end=std::min(numInstances, (batch+1)*WORLD_BONE_TRANSFORMATIONS_BATCH_SIZE);
+            for(size_t ci=batch*WORLD_BONE_TRANSFORMATIONS_BATCH_SIZE;ci<end;ci++) {
+                const Pose& pose=instancePose(ci);
+                AffineTransformation worldTransformation(worldTransformations[ci]);
+                AffineTransformation* instanceResult=&result[ci*boneIds.size()];
+                for(unsigned int cb=0;cb<boneIds.size();cb++)
+                    instanceResult[cb]=worldTransformation*AffineTransformation(pose.globalTransformations[boneIds[cb]]);
+            }
+        });
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, result.size());
+    }
 
-class Animation {
 public:
-    class Channel {
-    public:
-        unsigned int boneId;
+    AllocatorVector<AnimationType, allocator_type> animations;
+    std::vector<Bone> bones;
+    //The boneIds are stable after read, so look up the bones used every frame once, for instance with findBoneId,
+    //rather than hashing their names every frame
+    std::unordered_map<std::string, unsigned int> boneName2boneId;
+    //Name of each bone, indexed by boneId
+    std::vector<std::string> boneNames;
 
-        std::vector<aiVectorKey> positions;
-        std::vector<aiQuatKey> rotations;
-        std::vector<aiVectorKey> scales;
-    };
+    //Key cursors per animation and channel, used by createFrame to find the keys in O(1) during normal playback
+    std::vector<std::vector<Animation::ChannelCursor> > channelCursors;
 
-    double duration;
-    double ticksPerSecond;
+    //The bone transformations as read, used for the bones that are not animated when blending animation layers
+    LocalPose restPose;
 
-    std::vector<Channel> channels;
+    //Animations sampled at a fixed rate, indexed by animationId, see bakeAnimations
+    std::vector<BakedAnimation> bakedAnimations;
 
-private:
-    aiVector3D interpolateFunction(const aiVector3D& beforeMatrix, const aiVector3D& afterMatrix, double factor) const {
-        aiVector3D diffMatrix=afterMatrix-beforeMatrix;
-        diffMatrix*=factor;
+    //Levels of detail sorted by distance, see addLod
+    std::vector<Lod> lods;
 
-        return beforeMatrix+diffMatrix;
-    }
-    aiQuaternion interpolateFunction(const aiQuaternion& beforeMatrix, const aiQuaternion& afterMatrix, double factor) const {
-        aiQuaternion returnMatrix;
-        aiQuaternion::Interpolate(returnMatrix, beforeMatrix, afterMatrix, factor);
+    //Set to true before calling read to skin the meshes on the GPU.
+    //Bind-pose vertices, bone ids and bone weights are then uploaded once in upload, called by read, 
+    //and only the bone matrices are sent to the GPU when drawing a frame.
+    //Requires OpenGL 2.0 and a current OpenGL context when read or upload is called.
+    //Meshes with more than SKINNING_SHADER_MAX_BONES bones, or all meshes without SKELETAL_ANIMATION_MODEL_GL_3_1, are still skinned on the CPU.
+    bool gpuSkinning=false;
 
-        return returnMatrix;
+    //Set to true, in addition to gpuSkinning, before calling read to draw many instances 
+    //with one draw call per mesh using drawInstances.
+    //Requires OpenGL 3.1, or the ARB_draw_instanced, ARB_texture_buffer_object and EXT_gpu_shader4 extensions.
+    bool gpuInstancing=false;
+
+    //Set to true to skin with dual quaternions instead of blending the bone matrices, on the CPU and, if set before read, on the GPU.
+    //Avoids the collapsing joints of linear blend skinning when bones twist, and halves the bone palettes sent to the GPU.
+    //Scaling in the bone transformations is ignored, see DualQuaternion.
+    bool dualQuaternionSkinning=false;
+
+    //Set to true, in addition to gpuSkinning, before calling read to skin BufferFrames with transform feedback, see getMeshFrame taking a BufferFrame.
+    //Requires OpenGL 3.0. Otherwise, and for meshes with more than SKINNING_SHADER_MAX_BONES bones, BufferFrames are skinned on the CPU.
+    bool transformFeedbackSkinning=false;
+
+    //The meshes, their bone weights and the animations are allocated with allocator, for instance from an arena: 
+    //Arena arena; SkeletalAnimationModel<Material, ArenaMeshExtended> model(arena);
+    explicit SkeletalAnimationModel(const allocator_type& allocator=allocator_type()): Model<MaterialType, MeshType>(allocator), animations(allocator) {}
+
+    //Updates Bone::globalTransformation from Bone::transformation in one pass, since parent bones come before their children.
+    //Run after changing bones[].transformation directly, before getMeshFrame or drawMeshFrame.
+    void updateGlobalBoneTransformations() {
+        SKELETAL_ANIMATION_MODEL_TIME(BONE_TRANSFORMATIONS);
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, bones.size());
+        for(auto& bone: bones) {
+            if(bone.hasParentBoneId)
+                bone.globalTransformation=bones[bone.parentBoneId].globalTransformation*bone.transformation;
+            else
+                bone.globalTransformation=bone.transformation;
+        }
+        clearDirtyBones(dirtyBones, firstDirtyBoneId);
+        frameKey.valid=false;
     }
-public:
-    //time in seconds
-    template<class KeyType>
-    auto interpolate(const std::vector<KeyType>& keys, double time, bool loop=true) const -> decltype(keys.begin()->mValue) {
-        time*=ticksPerSecond;
 
-        if(loop) {
-            time=fmod(time, duration);
+    //Same as above, for the given pose.
+    //Run after changing pose.transformations directly.
+    void updateGlobalBoneTransformations(Pose& pose) const {
+        SKELETAL_ANIMATION_MODEL_TIME(BONE_TRANSFORMATIONS);
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, bones.size());
+        for(unsigned int cb=0;cb<bones.size();cb++) {
+            if(bones[cb].hasParentBoneId)
+                pose.globalTransformations[cb]=pose.globalTransformations[bones[cb].parentBoneId]*pose.transformations[cb];
+            else
+                pose.globalTransformations[cb]=pose.transformations[cb];
         }
-        else if(time>=duration) {
-            return keys[keys.size()-1].mValue;
+        clearDirtyBones(pose.dirtyBones, pose.firstDirtyBoneId);
+        pose.frameKey.valid=false;
+    }
+
+    //Replaces the transformation of the given bone, for instance to aim a head or to apply an IK solution after createFrame.
+    //The bone and its descendants are then updated by updateDirtyBoneTransformations, instead of all the bones.
+    //After createBakedFrame, which only updates the global transformations, the transformations of the bones are first recovered
+    //from the baked global transformations, so that the descendants stay in the baked frame.
+    void setBoneTransformation(unsigned int boneId, const aiVector3D& scale, const aiQuaternion& rotation, const aiVector3D& position) {
+        if(frameKey.valid && frameKey.baked)
+            recoverBakedTransformations();
+        bones[boneId].transformation=aiMatrix4x4Compose(scale, rotation, position);
+        setLocalPose(localPose, boneId, scale, rotation, position);
+        markDirtyBone(dirtyBones, firstDirtyBoneId, boneId);
+        frameKey.valid=false;
+    }
+
+    //Same as above, for the given pose
+    void setBoneTransformation(Pose& pose, unsigned int boneId, const aiVector3D& scale, const aiQuaternion& rotation, const aiVector3D& position) const {
+        if(pose.frameKey.valid && pose.frameKey.baked)
+            recoverBakedTransformations(pose);
+        pose.transformations[boneId]=aiMatrix4x4Compose(scale, rotation, position);
+        setLocalPose(pose.localPose, boneId, scale, rotation, position);
+        markDirtyBone(pose.dirtyBones, pose.firstDirtyBoneId, boneId);
+        pose.frameKey.valid=false;
+    }
+
+    //Updates Bone::globalTransformation of the bones changed by setBoneTransformation and of their descendants only.
+    //Bone::transformation of the descendants must match the current frame, as after createFrame, or after createBakedFrame 
+    //followed by setBoneTransformation, which recovers them. Run updateGlobalBoneTransformations instead after changing Bone::transformation directly.
+    //Since the bones are sorted by depth, a subtree is not contiguous: each bone after the first changed bone is checked,
+    //in one pass since parent bones come before their children.
+    void updateDirtyBoneTransformations() {
+        SKELETAL_ANIMATION_MODEL_TIME(BONE_TRANSFORMATIONS);
+        size_t numMultiplied=0;
+        for(unsigned int cb=firstDirtyBoneId;cb<dirtyBones.size();cb++) {
+            auto& bone=bones[cb];
+            if(!dirtyBones[cb]) {
+                if(!bone.hasParentBoneId || !dirtyBones[bone.parentBoneId])
+                    continue;
+                dirtyBones[cb]=1;
+            }
+            if(bone.hasParentBoneId)
+                bone.globalTransformation=bones[bone.parentBoneId].globalTransformation*bone.transformation;
+            else
+                bone.globalTransformation=bone.transformation;
+            numMultiplied++;
         }
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, numMultiplied);
+        clearDirtyBones(dirtyBones, firstDirtyBoneId);
+    }
 
-        unsigned int keyBefore=0, keyAfter=0;
-        double frameDuration=1.0, frameTime=0.0;
-        for(unsigned int cv=0;cv<keys.size();cv++) {
-            if(time<keys[cv].mTime) {
-                keyAfter=cv;
-                if(cv==0) {
-                    keyBefore=keys.size()-1;
-                    frameDuration=keys[0].mTime;
-                    frameTime=time;
-                }
-                else {
-                    keyBefore=cv-1;
-                    frameDuration=keys[keyAfter].mTime-keys[keyBefore].mTime;
-                    frameTime=time-keys[keyBefore].mTime;
-                }
-                break;
+    //Same as above, for the given pose
+    void updateDirtyBoneTransformations(Pose& pose) const {
+        SKELETAL_ANIMATION_MODEL_TIME(BONE_TRANSFORMATIONS);
+        auto& dirtyBones=pose.dirtyBones;
+        size_t numMultiplied=0;
+        for(unsigned int cb=pose.firstDirtyBoneId;cb<dirtyBones.size();cb++) {
+            if(!dirtyBones[cb]) {
+                if(!bones[cb].hasParentBoneId || !dirtyBones[bones[cb].parentBoneId])
+                    continue;
+                dirtyBones[cb]=1;
             }
+            if(bones[cb].hasParentBoneId)
+                pose.globalTransformations[cb]=pose.globalTransformations[bones[cb].parentBoneId]*pose.transformations[cb];
+            else
+                pose.globalTransformations[cb]=pose.transformations[cb];
+            numMultiplied++;
         }
+        SKELETAL_ANIMATION_MODEL_COUNT(MATRICES_MULTIPLIED, numMultiplied);
+        clearDirtyBones(dirtyBones, pose.firstDirtyBoneId);
+    }
 
-        double factor=frameTime/frameDuration;
+    //Returns a new pose with the current bone transformations of the model
+    Pose createPose() const {
+        Pose pose;
+        pose.transformations.reserve(bones.size());
+        pose.globalTransformations.reserve(bones.size());
+        for(auto& bone: bones) {
+            pose.transformations.emplace_back(bone.transformation);
+            pose.globalTransformations.emplace_back(bone.globalTransformation);
+        }
+        pose.localPose=localPose;
+        return pose;
+    }
+
+    //Updates the transformation matrices for the bones that are part of the animation channels, 
+    //and then the global transformation matrices of all the bones.
+    //Which bones get their transformation matrices updated can be found in animations[animationId].channels[].boneId
+    //Does nothing if the previous frame was created with the same arguments, see FrameKey, 
+    //and otherwise only the bones with changed transformation matrices and their descendants are updated.
+    void createFrame(unsigned int animationId, double time, bool loop=true) {
+        FrameKey newFrameKey(false, animationId, time, loop);
+        if(frameKey==newFrameKey)
+            return;
+        createFrameFromKey(newFrameKey, [](BoneOverrides&) {});
+    }
 
-        return interpolateFunction(keys[keyBefore].mValue, keys[keyAfter].mValue, factor);
+    //Same as above, but updates the given pose instead of the model
+    void createFrame(Pose& pose, unsigned int animationId, double time, bool loop=true) const {
+        FrameKey newFrameKey(false, animationId, time, loop);
+        if(pose.frameKey==newFrameKey)
+            return;
+        createFrameFromKey(pose, newFrameKey, [](BoneOverrides&) {});
     }
-};
 
-template<class MaterialType=Material, class MeshType=MeshExtended>
-class SkeletalAnimationModel : public Model<MaterialType, MeshType> {
-public:
-    class MeshFrame {
-    public:
-        std::vector<aiVector3D> vertices;
-        std::vector<aiVector3D> normals;
+    //Same as above, but overrideBones is called with BoneOverrides between sampling the animation and updating the transformation matrices,
+    //for instance to rotate a head procedurally: [headBoneId](BoneOverrides& overrides) {overrides.setRotation(headBoneId, ...*overrides.rotation(headBoneId));}
+    //The scales, rotations and positions are overridden directly, without decomposing the transformation matrices, 
+    //and only the overridden bones, the bones with changed channels and their descendants are updated.
+    //The overrides only last for this frame, and the frame is never skipped, see FrameKey::overridden.
+    template<class OverrideBones>
+    void createFrame(unsigned int animationId, double time, bool loop, const OverrideBones& overrideBones) {
+        FrameKey newFrameKey(false, animationId, time, loop);
+        newFrameKey.overridden=true;
+        createFrameFromKey(newFrameKey, overrideBones);
+    }
 
-        const MeshType& mesh;
-        
-        MeshFrame(const MeshType& mesh): vertices(mesh.vertices.size()), normals(mesh.normals.size()), mesh(mesh) {}
-    };
-    
-private:
-    //Add bone if it does not yet exist, and return boneId
-    unsigned int getBoneId(const aiNode* node) {
-        unsigned int boneId;
-        if(boneName2boneId.count(node->mName.data)==0) {
-            bones.emplace_back();
-            boneId=bones.size()-1;
-            boneName2boneId[node->mName.data]=boneId;
+    //Same as above, but updates the given pose instead of the model
+    template<class OverrideBones>
+    void createFrame(Pose& pose, unsigned int animationId, double time, bool loop, const OverrideBones& overrideBones) const {
+        FrameKey newFrameKey(false, animationId, time, loop);
+        newFrameKey.overridden=true;
+        createFrameFromKey(pose, newFrameKey, overrideBones);
+    }
+
+    //Blends the given animation layers in order, each layer sampled once, and then updates the transformation matrices 
+    //of all the bones, and their global transformation matrices. Bones without channels in the layers get their restPose.
+    //For instance a crossfade from walk to run: {AnimationLayer(walkId, time), AnimationLayer(runId, time, true, fade)}
+    void createFrame(const std::vector<AnimationLayer>& layers) {
+        createFrame(layers, [](BoneOverrides&) {});
+    }
 
-            bones[boneId].transformation=node->mTransformation;
+    //Same as above, but updates the given pose instead of the model
+    void createFrame(Pose& pose, const std::vector<AnimationLayer>& layers) const {
+        createFrame(pose, layers, [](BoneOverrides&) {});
+    }
+
+    //Same as above, but overrideBones is called with BoneOverrides of the blended LocalPose before the transformation matrices are composed
+    template<class OverrideBones>
+    void createFrame(const std::vector<AnimationLayer>& layers, const OverrideBones& overrideBones) {
+        blendLayers(layers, channelCursors, localPose);
+        composeLocalPose(localPose, boneOverrides, [this](unsigned int boneId) -> aiMatrix4x4& {
+            return bones[boneId].transformation;
+        }, overrideBones);
+        updateGlobalBoneTransformations();
+    }
+
+    //Same as above, but updates the given pose instead of the model
+    template<class OverrideBones>
+    void createFrame(Pose& pose, const std::vector<AnimationLayer>& layers, const OverrideBones& overrideBones) const {
+        blendLayers(layers, pose.channelCursors, pose.localPose);
+        composeLocalPose(pose.localPose, pose.boneOverrides, [&pose](unsigned int boneId) -> aiMatrix4x4& {
+            return pose.transformations[boneId];
+        }, overrideBones);
+        updateGlobalBoneTransformations(pose);
+    }
+
+    //Samples the global bone transformations of each animation at framesPerSecond, to be looked up by createBakedFrame
+    //instead of sampling the channels and updating the global transformations every frame.
+    //If the baked animations would use more than maxBytes, the frame rate is lowered to fit, with at least 2 frames per animation.
+    //Run after read, and after changing the animations or the transformations of the bones without channels.
+    void bakeAnimations(double framesPerSecond=30.0, size_t maxBytes=std::numeric_limits<size_t>::max()) {
+        size_t frameBytes=bones.size()*sizeof(AffineTransformation);
+        double durationBytes=0.0, fixedBytes=0.0;
+        for(auto& animation: animations) {
+            if(animation.ticksPerSecond>0.0) {
+                durationBytes+=animation.duration/animation.ticksPerSecond*framesPerSecond*frameBytes;
+                fixedBytes+=2*frameBytes;
+            }
         }
-        else {
-            boneId=boneName2boneId[node->mName.data];
+        if(durationBytes>0.0 && durationBytes+fixedBytes>maxBytes)
+            framesPerSecond*=std::max(maxBytes-fixedBytes, 0.0)/durationBytes;
+
+        bakedAnimations.assign(animations.size(), BakedAnimation());
+        Pose pose=createPose();
+        for(unsigned int ca=0;ca<animations.size();ca++) {
+            auto& animation=animations[ca];
+            if(animation.ticksPerSecond<=0.0 || animation.duration<=0.0)
+                continue;
+            auto& bakedAnimation=bakedAnimations[ca];
+            bakedAnimation.duration=animation.duration/animation.ticksPerSecond;
+            unsigned int numFrames=std::max(static_cast<unsigned int>(bakedAnimation.duration*framesPerSecond), 1u);
+            bakedAnimation.framesPerSecond=numFrames/bakedAnimation.duration;
+            bakedAnimation.numBones=bones.size();
+            bakedAnimation.frames.resize((numFrames+1)*bones.size());
+            for(unsigned int cf=0;cf<=numFrames;cf++) {
+                if(cf<numFrames)
+                    createFrame(pose, ca, cf/bakedAnimation.framesPerSecond);
+                else
+                    createFrame(pose, ca, bakedAnimation.duration, false);
+                for(unsigned int cb=0;cb<bones.size();cb++)
+                    bakedAnimation.frames[cf*bones.size()+cb]=AffineTransformation(pose.globalTransformations[cb]);
+            }
         }
+    }
 
-        return boneId;
+    //Same as createFrame, but looks up the global bone transformations in bakedAnimations[animationId], 
+    //interpolating between the two nearest frames if interpolate is true.
+    //Only Bone::globalTransformation is updated, and Bone::transformation is recovered from it by setBoneTransformation if needed.
+    //Falls back to createFrame if the animation is not baked.
+    void createBakedFrame(unsigned int animationId, double time, bool loop=true, bool interpolate=true) {
+        FrameKey newFrameKey(true, animationId, time, loop, interpolate);
+        if(frameKey==newFrameKey)
+            return;
+        if(sampleBakedAnimation(animationId, time, loop, interpolate, [this](unsigned int boneId, const AffineTransformation& globalTransformation) {
+            bones[boneId].globalTransformation=globalTransformation.matrix();
+        }))
+            frameKey=newFrameKey;
+        else
+            createFrame(animationId, time, loop);
     }
 
-public:
-    std::vector<Animation> animations;
-    std::vector<Bone> bones;
-    std::unordered_map<std::string, unsigned int> boneName2boneId;
+    //Same as above, but updates pose.globalTransformations instead of the model
+    void createBakedFrame(Pose& pose, unsigned int animationId, double time, bool loop=true, bool interpolate=true) const {
+        FrameKey newFrameKey(true, animationId, time, loop, interpolate);
+        if(pose.frameKey==newFrameKey)
+            return;
+        if(sampleBakedAnimation(animationId, time, loop, interpolate, [&pose](unsigned int boneId, const AffineTransformation& globalTransformation) {
+            pose.globalTransformations[boneId]=globalTransformation.matrix();
+        }))
+            pose.frameKey=newFrameKey;
+        else
+            createFrame(pose, animationId, time, loop);
+    }
 
-    //Updates the transformation matrices for the bones that are part of the animation channels.
-    //Which bones get their transformation matrices updated can be found in animations[animationId].channels[].boneId
-    void createFrame(unsigned int animationId, double time, bool loop=true) {
-        if(animationId<animations.size()) {
-            for(auto& channel: animations[animationId].channels) { 
-                aiVector3D scale=animations[animationId].interpolate(channel.scales, time, loop);
-                aiQuaternion rotation=animations[animationId].interpolate(channel.rotations, time, loop);
-                aiVector3D position=animations[animationId].interpolate(channel.positions, time, loop);
-                bones[channel.boneId].transformation=aiMatrix4x4Compose(scale, rotation, position);
+    //Returns the boneId of the named bone, to index bones and the Pose transformations with.
+    //Throws std::runtime_error if the bone is not found.
+    unsigned int findBoneId(const std::string& boneName) const {
+        auto it=boneName2boneId.find(boneName);
+        if(it==boneName2boneId.end())
+            throw std::runtime_error("SkeletalAnimationModel::findBoneId: bone "+boneName+" not found");
+        return it->second;
+    }
+
+    //Returns a bone mask for AnimationLayer::boneMask with the given weight for the named bone and its children, and 0 for the other bones.
+    //For instance createBoneMask("spine") for an upper body layer.
+    std::vector<float> createBoneMask(const std::string& boneName, float weight=1.0) const {
+        std::vector<float> boneMask(bones.size(), 0.0);
+        auto it=boneName2boneId.find(boneName);
+        if(it!=boneName2boneId.end()) {
+            boneMask[it->second]=weight;
+            //Parent bones come before their children
+            for(unsigned int cb=it->second+1;cb<bones.size();cb++) {
+                if(bones[cb].hasParentBoneId && bones[cb].parentBoneId>=it->second && boneMask[bones[cb].parentBoneId]>0.0)
+                    boneMask[cb]=weight;
             }
         }
+        return boneMask;
+    }
+
+    //Returns a bounding box of the given mesh skinned by getMeshFrame, from the global transformations of its bones and their bind-pose bounding boxes
+    //(see BoneWeights::boundingBox), without skinning the vertices. The box may be larger than the skinned mesh, but contains it,
+    //except with dualQuaternionSkinning where the blended rotations can move vertices outside, and the box should then be enlarged for culling.
+    //For instance to cull meshes before skinning them, see Frustum. Run after SkeletalAnimationModel::createFrame.
+    BoundingBox getBoundingBox(const MeshType& mesh) const {
+        return getSkinnedBoundingBox([this](unsigned int boneId) -> const aiMatrix4x4& {
+            return bones[boneId].globalTransformation;
+        }, mesh);
+    }
+
+    //Same as above, for the given pose
+    BoundingBox getBoundingBox(const Pose& pose, const MeshType& mesh) const {
+        return getSkinnedBoundingBox([&pose](unsigned int boneId) -> const aiMatrix4x4& {
+            return pose.globalTransformations[boneId];
+        }, mesh);
+    }
+
+    //Returns a bounding box of all the meshes, see getBoundingBox(const MeshType&)
+    BoundingBox getBoundingBox() const {
+        BoundingBox boundingBox;
+        for(auto& mesh: this->meshes)
+            boundingBox.add(getBoundingBox(mesh));
+        return boundingBox;
+    }
+
+    //Same as above, for the given pose
+    BoundingBox getBoundingBox(const Pose& pose) const {
+        BoundingBox boundingBox;
+        for(auto& mesh: this->meshes)
+            boundingBox.add(getBoundingBox(pose, mesh));
+        return boundingBox;
+    }
+
+    //Writes the world transformations of the given bones of each pose to result, resized to poses.size()*boneIds.size(), 
+    //where result[ci*boneIds.size()+cb] is bone boneIds[cb] of poses[ci] placed by worldTransformations[ci].
+    //For instance the hit boxes and attachment points of many instances on a server, 
+    //with the poses created by createFrame or createBakedFrame without any meshes, see Model::readMeshes.
+    //Runs as parallel jobs of WORLD_BONE_TRANSFORMATIONS_BATCH_SIZE poses if jobSystem is given.
+    //Throws std::runtime_error if a boneId is invalid.
+    void getWorldBoneTransformations(const std::vector<Pose>& poses, const std::vector<aiMatrix4x4>& worldTransformations,
+                                     const std::vector<unsigned int>& boneIds, std::vector<AffineTransformation>& result, 
+                                     JobSystem* jobSystem=nullptr) const {
+        getInstanceBoneTransformations([&poses](size_t instanceId) -> const Pose& {
+            return poses[instanceId];
+        }, worldTransformations.data(), std::min(poses.size(), worldTransformations.size()), boneIds, result, jobSystem);
+    }
+
+    //Same as above, but for frame jobs of this model created with createFrames
+    void getWorldBoneTransformations(const std::vector<FrameJob>& frameJobs, const std::vector<aiMatrix4x4>& worldTransformations,
+                                     const std::vector<unsigned int>& boneIds, std::vector<AffineTransformation>& result, 
+                                     JobSystem* jobSystem=nullptr) const {
+        getInstanceBoneTransformations([&frameJobs](size_t instanceId) -> const Pose& {
+            return frameJobs[instanceId].pose;
+        }, worldTransformations.data(), std::min(frameJobs.size(), worldTransformations.size()), boneIds, result, jobSystem);
     }
 
     //Receives the frame vertices and normals for the given mesh.
     //Run after SkeletalAnimationModel::createFrame.
     MeshFrame getMeshFrame(const MeshType& mesh) const {
         MeshFrame meshFrame(mesh);
+        getMeshFrame(mesh, meshFrame.vertices.data(), meshFrame.normals.data());
+        return meshFrame;
+    }
 
-        //Calculate new frame vertices and normals
-        for(unsigned int cb=0;cb<mesh.boneWeights.size();cb++) {
-            const auto& boneWeights=mesh.boneWeights[cb];
+    //Receives the frame vertices and normals for meshFrame.mesh into the existing meshFrame.
+    //Reusing a MeshFrame between frames avoids allocating its vertices and normals every frame,
+    //and skips skinning it again if none of the bones of the mesh have moved when MeshFrame::reuseIfUnchanged is set.
+    //Run after SkeletalAnimationModel::createFrame.
+    void getMeshFrame(MeshFrame& meshFrame) const {
+        auto globalTransformation=[this](unsigned int boneId) -> const aiMatrix4x4& {
+            return bones[boneId].globalTransformation;
+        };
+        if(isMeshFrameCurrent(globalTransformation, meshFrame, nullptr, 4))
+            return;
+        meshFrame.vertices.resize(meshFrame.mesh.vertices.size());
+        meshFrame.normals.resize(meshFrame.mesh.normals.size());
+        getMeshFrame(meshFrame.mesh, meshFrame.vertices.data(), meshFrame.normals.data());
+    }
 
-            aiMatrix4x4 transformation;
-            const std::function<void(unsigned int)> calculateBoneTransformation=[&](unsigned int boneId){
-                if(bones[boneId].hasParentBoneId) {
-                    calculateBoneTransformation(bones[boneId].parentBoneId);
+    //Receives the frame vertices and normals for the given mesh into caller-owned arrays, 
+    //each with mesh.vertices.size() elements.
+    //Uses the per-vertex bone influences if no vertex has more than 4 bone weights, 
+    //and otherwise accumulates the weights from MeshExtended::boneWeights.
+    //Run after SkeletalAnimationModel::createFrame.
+    void getMeshFrame(const MeshType& mesh, aiVector3D* vertices, aiVector3D* normals) const {
+        skinMesh([this](unsigned int boneId) -> const aiMatrix4x4& {
+            return bones[boneId].globalTransformation;
+        }, mesh, vertices, normals);
+    }
+
+    //Same as the getMeshFrame functions above, but for the given pose
+    MeshFrame getMeshFrame(const Pose& pose, const MeshType& mesh) const {
+        MeshFrame meshFrame(mesh);
+        getMeshFrame(pose, mesh, meshFrame.vertices.data(), meshFrame.normals.data());
+        return meshFrame;
+    }
+
+    void getMeshFrame(const Pose& pose, MeshFrame& meshFrame) const {
+        auto globalTransformation=[&pose](unsigned int boneId) -> const aiMatrix4x4& {
+            return pose.globalTransformations[boneId];
+        };
+        if(isMeshFrameCurrent(globalTransformation, meshFrame, nullptr, 4))
+            return;
+        meshFrame.vertices.resize(meshFrame.mesh.vertices.size());
+        meshFrame.normals.resize(meshFrame.mesh.normals.size());
+        getMeshFrame(pose, meshFrame.mesh, meshFrame.vertices.data(), meshFrame.normals.data());
+    }
+
+    void getMeshFrame(const Pose& pose, const MeshType& mesh, aiVector3D* vertices, aiVector3D* normals) const {
+        skinMesh([&pose](unsigned int boneId) -> const aiMatrix4x4& {
+            return pose.globalTransformations[boneId];
+        }, mesh, vertices, normals);
+    }
+
+    //Same as getMeshFrame(pose, meshFrame), where meshFrame.mesh is one of getLodMeshes(lod), 
+    //skinned with the bone influences of the given level of detail
+    void getMeshFrame(const Pose& pose, MeshFrame& meshFrame, unsigned int lod) const {
+        const AllocatorVector<float, allocator_type>* boneInfluenceWeights=nullptr;
+        unsigned int maxBoneInfluences=4;
+        if(lod>0 && lod<=lods.size()) {
+            //meshFrame.mesh may be a mesh of another vector, so the pointers are only subtracted if it is one of the meshes
+            const auto& meshes=getLodMeshes(lod);
+            std::less<const MeshType*> less;
+            size_t meshId=meshes.size();
+            if(!less(&meshFrame.mesh, meshes.data()) && less(&meshFrame.mesh, meshes.data()+meshes.size()))
+                meshId=&meshFrame.mesh-meshes.data();
+            if(meshId<lods[lod-1].boneInfluenceWeights.size()) {
+                boneInfluenceWeights=&lods[lod-1].boneInfluenceWeights[meshId];
+                maxBoneInfluences=lods[lod-1].maxBoneInfluences;
+                //The mesh already has at most maxBoneInfluences weights per vertex, so only its used influences are skinned
+                if(boneInfluenceWeights->empty()) {
+                    boneInfluenceWeights=&meshFrame.mesh.boneInfluenceWeights;
+                    maxBoneInfluences=std::max(std::min(maxBoneInfluences, meshFrame.mesh.maxBoneWeightsPerVertex), 1u);
                 }
-                transformation*=bones[boneId].transformation;
-            };
-            calculateBoneTransformation(boneWeights.boneId);
-            transformation*=boneWeights.offsetMatrix;
+            }
+        }
+        auto globalTransformation=[&pose](unsigned int boneId) -> const aiMatrix4x4& {
+            return pose.globalTransformations[boneId];
+        };
+        if(isMeshFrameCurrent(globalTransformation, meshFrame, boneInfluenceWeights, maxBoneInfluences))
+            return;
+        meshFrame.vertices.resize(meshFrame.mesh.vertices.size());
+        meshFrame.normals.resize(meshFrame.mesh.normals.size());
+        skinMesh(globalTransformation, meshFrame.mesh, meshFrame.vertices.data(), meshFrame.normals.data(), boneInfluenceWeights, maxBoneInfluences);
+    }
 
-            for(auto& weight: boneWeights.weights) {
-                meshFrame.vertices[weight.mVertexId]+=weight.mWeight*(transformation*mesh.vertices[weight.mVertexId]);
-                meshFrame.normals[weight.mVertexId]+=weight.mWeight*(aiMatrix3x3(transformation)*mesh.normals[weight.mVertexId]);
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //Skins bufferFrame.mesh once into bufferFrame.vertexBuffer, to be drawn by each rendering pass with drawMeshFrame(const BufferFrame&).
+    //Uses transform feedback if transformFeedbackSkinning was set before read, and otherwise skins on the CPU and uploads the vertices.
+    //Requires a current OpenGL context. Run after SkeletalAnimationModel::createFrame.
+    void getMeshFrame(BufferFrame& bufferFrame) const {
+        skinToBuffer([this](unsigned int boneId) -> const aiMatrix4x4& {
+            return bones[boneId].globalTransformation;
+        }, bufferFrame);
+    }
+
+    //Same as above, but for the given pose
+    void getMeshFrame(const Pose& pose, BufferFrame& bufferFrame) const {
+        skinToBuffer([&pose](unsigned int boneId) -> const aiMatrix4x4& {
+            return pose.globalTransformations[boneId];
+        }, bufferFrame);
+    }
+#endif
+
+    //Adds a level of detail for instances at or beyond distance, see Lod.
+    //The optional simplifiedModel, for instance read from a low polygon version of the model file, 
+    //is drawn instead and must have bones with the same names as this model.
+    //Run after read. Throws std::runtime_error if a bone of simplifiedModel is not found.
+    void addLod(double distance, unsigned int maxBoneInfluences, unsigned int updateInterval=1, const SkeletalAnimationModel* simplifiedModel=nullptr) {
+        Lod lod(this->meshes.get_allocator());
+        lod.distance=distance;
+        lod.maxBoneInfluences=std::min(std::max(maxBoneInfluences, 1u), 4u);
+        lod.updateInterval=std::max(updateInterval, 1u);
+
+        if(simplifiedModel) {
+            const auto& boneNames=simplifiedModel->boneNames;
+            lod.meshes=simplifiedModel->meshes;
+            for(auto& mesh: lod.meshes) {
+                for(auto& boneWeights: mesh.boneWeights) {
+                    auto it=boneName2boneId.find(boneNames[boneWeights.boneId]);
+                    if(it==boneName2boneId.end())
+                        throw std::runtime_error("SkeletalAnimationModel: bone "+boneNames[boneWeights.boneId]+" of the simplified model not found");
+                    boneWeights.boneId=it->second;
+                }
             }
         }
 
-        return meshFrame;
+        for(auto& mesh: lod.meshes.empty() ? this->meshes : lod.meshes) {
+            lod.boneInfluenceWeights.emplace_back(this->meshes.get_allocator());
+            if(mesh.maxBoneWeightsPerVertex<=lod.maxBoneInfluences)
+                continue;
+            auto& weights=lod.boneInfluenceWeights.back();
+            weights=mesh.boneInfluenceWeights;
+            for(unsigned int cv=0;cv<mesh.vertices.size();cv++) {
+                float sum=0.0;
+                for(unsigned int c=0;c<lod.maxBoneInfluences;c++)
+                    sum+=weights[cv*4+c];
+                for(unsigned int c=0;c<4;c++) {
+                    if(c>=lod.maxBoneInfluences)
+                        weights[cv*4+c]=0.0;
+                    else if(sum>0.0)
+                        weights[cv*4+c]/=sum;
+                }
+            }
+        }
+
+        auto it=std::upper_bound(lods.begin(), lods.end(), distance, [](double distance, const Lod& lod) {
+            return distance<lod.distance;
+        });
+        lods.insert(it, std::move(lod));
+    }
+
+    //Returns the level of detail for an instance at the given distance, 0 for full detail, and lod>0 for lods[lod-1]
+    unsigned int getLod(double distance) const {
+        return std::upper_bound(lods.begin(), lods.end(), distance, [](double distance, const Lod& lod) {
+            return distance<lod.distance;
+        })-lods.begin();
     }
 
+    //Returns the meshes drawn at the given level of detail
+    const AllocatorVector<MeshType, allocator_type>& getLodMeshes(unsigned int lod) const {
+        if(lod>0 && lod<=lods.size() && !lods[lod-1].meshes.empty())
+            return lods[lod-1].meshes;
+        return this->meshes;
+    }
+
+#ifndef SKELETAL_ANIMATION_MODEL_NO_GL
     //Draws the given mesh frame.
     //Currently only supports 1 diffuse texture per material
     virtual void drawMeshFrame(const MeshFrame& meshFrame) const {
+        SKELETAL_ANIMATION_MODEL_TIME(DRAWING);
         const MeshType& mesh=meshFrame.mesh;
         
         bool texture=false;
-        if(this->materials[mesh.materialId].texture())
+        if(this->materials[mesh.materialId].texture() && !mesh.textureCoords.empty())
             texture=true;
+        SKELETAL_ANIMATION_MODEL_COUNT(BYTES_UPLOADED, mesh.indices.size()*(2*sizeof(aiVector3D)+(texture ? 2*sizeof(float) : 0)));
 
         //If material has texture, use only the first one (assumes one diffuse texture per material).
         //However, if you want to use more than one texture per mesh, read: http://assimp.sourceforge.net/lib_html/materials.html
@@ -231,43 +2563,205 @@ public:
         }
 
         glBegin(GL_TRIANGLES);
-        for(auto& face: mesh.faces) {
-            glNormal3f(meshFrame.normals[face.mIndices[0]].x, meshFrame.normals[face.mIndices[0]].y, meshFrame.normals[face.mIndices[0]].z);
-            if(texture)
-                glTexCoord2f(mesh.textureCoords[face.mIndices[0]].x, mesh.textureCoords[face.mIndices[0]].y);
-            glVertex3f(meshFrame.vertices[face.mIndices[0]].x, meshFrame.vertices[face.mIndices[0]].y, meshFrame.vertices[face.mIndices[0]].z);
-
-            glNormal3f(meshFrame.normals[face.mIndices[1]].x, meshFrame.normals[face.mIndices[1]].y, meshFrame.normals[face.mIndices[1]].z);
+        for(auto index: mesh.indices) {
+            glNormal3f(meshFrame.normals[index].x, meshFrame.normals[index].y, meshFrame.normals[index].z);
             if(texture)
-                glTexCoord2f(mesh.textureCoords[face.mIndices[1]].x, mesh.textureCoords[face.mIndices[1]].y);                    
-            glVertex3f(meshFrame.vertices[face.mIndices[1]].x, meshFrame.vertices[face.mIndices[1]].y, meshFrame.vertices[face.mIndices[1]].z);
-
-            glNormal3f(meshFrame.normals[face.mIndices[2]].x, meshFrame.normals[face.mIndices[2]].y, meshFrame.normals[face.mIndices[2]].z);
-            if(texture)
-                glTexCoord2f(mesh.textureCoords[face.mIndices[2]].x, mesh.textureCoords[face.mIndices[2]].y);
-            glVertex3f(meshFrame.vertices[face.mIndices[2]].x, meshFrame.vertices[face.mIndices[2]].y, meshFrame.vertices[face.mIndices[2]].z);
+                glTexCoord2f(mesh.textureCoords[index].x, mesh.textureCoords[index].y);
+            glVertex3f(meshFrame.vertices[index].x, meshFrame.vertices[index].y, meshFrame.vertices[index].z);
         }
         glEnd();
     }
 
-    //TODO: draw using newer OpenGL with skinning on GPU instead of CPU
-    //This function would then replace getMeshFrame and drawMeshFrame(const MeshFrame&)
-    //Also, when finished, drawFrame should use this function as follows:
-    //createFrame(animationId, time);
-    //for(auto& mesh: this->meshes)
-    //    drawMeshFrame(mesh);
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+    //Draws a mesh skinned by getMeshFrame taking a BufferFrame, from its vertex buffer as Model::drawMesh draws vertex buffer objects.
+    //Can be called any number of times per frame. The mesh is not drawn if it has no index buffer:
+    //set gpuSkinning or Model::vertexBufferObjects to true before calling read.
+    virtual void drawMeshFrame(const BufferFrame& bufferFrame) const {
+        SKELETAL_ANIMATION_MODEL_TIME(DRAWING);
+        const MeshType& mesh=bufferFrame.mesh;
+        if(!bufferFrame.vertexBuffer || !mesh.indexBuffer)
+            return;
+
+        bool texture=false;
+        if(this->materials[mesh.materialId].texture() && !mesh.textureCoords.empty())
+            texture=true;
+        if(texture)
+            this->materials[mesh.materialId].bindTexture(aiTextureType_DIFFUSE, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, bufferFrame.vertexBuffer.id());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer.id());
+        bufferFrame.vertexFormat.enableArrays(texture);
+
+        glDrawElements(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT, nullptr);
+
+        bufferFrame.vertexFormat.disableArrays(texture);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+#endif
+
+    //Draws the given mesh skinned on the GPU, see SkeletalAnimationModel::gpuSkinning.
+    //Run after SkeletalAnimationModel::createFrame. 
+    //Falls back to getMeshFrame and drawMeshFrame(const MeshFrame&) if the mesh is not uploaded to the GPU.
+    //Currently only supports 1 diffuse texture per material
     virtual void drawMeshFrame(const MeshType& mesh) const {
-        throw std::logic_error("Not implemented");
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+        if(skinningShader && mesh.skinningVertexBuffer) {
+            drawSkinnedMesh([this](unsigned int boneId) -> const aiMatrix4x4& {
+                return bones[boneId].globalTransformation;
+            }, mesh);
+            return;
+        }
+#endif
+        drawMeshFrame(getMeshFrame(mesh));
+    }
+
+    //Same as above, but for the given pose
+    virtual void drawMeshFrame(const Pose& pose, const MeshType& mesh) const {
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+        if(skinningShader && mesh.skinningVertexBuffer) {
+            drawSkinnedMesh([&pose](unsigned int boneId) -> const aiMatrix4x4& {
+                return pose.globalTransformations[boneId];
+            }, mesh);
+            return;
+        }
+#endif
+        drawMeshFrame(getMeshFrame(pose, mesh));
     }
     
+    //Draws the given poses, where pose ci is placed by instanceTransformations[ci] in addition to the current OpenGL model view matrix.
+    //The bone palettes of all the instances are uploaded to one texture buffer, and each mesh is drawn with one instanced draw call,
+    //see SkeletalAnimationModel::gpuInstancing. Otherwise, or for meshes not skinned on the GPU, the instances are drawn one at a time.
+    //The poses can for instance be created with createBakedFrame.
+    void drawInstances(const std::vector<Pose>& poses, const std::vector<aiMatrix4x4>& instanceTransformations) const {
+        drawInstancedPoses([&poses](size_t instanceId) -> const Pose& {
+            return poses[instanceId];
+        }, instanceTransformations.data(), std::min(poses.size(), instanceTransformations.size()));
+    }
+
+    //Same as above, but for frame jobs of this model created with createFrames.
+    //If not skinning on the GPU, the mesh frames of the frame jobs are drawn.
+    void drawInstances(const std::vector<FrameJob>& frameJobs, const std::vector<aiMatrix4x4>& instanceTransformations) const {
+        size_t numInstances=std::min(frameJobs.size(), instanceTransformations.size());
+        if(gpuSkinning) {
+            drawInstancedPoses([&frameJobs](size_t instanceId) -> const Pose& {
+                return frameJobs[instanceId].pose;
+            }, instanceTransformations.data(), numInstances);
+        }
+        else {
+            for(size_t ci=0;ci<numInstances;ci++) {
+                glPushMatrix();
+                glMultMatrixf(AffineTransformation(instanceTransformations[ci]).columns);
+                frameJobs[ci].draw();
+                glPopMatrix();
+            }
+        }
+    }
+#endif
+
+    //Creates the animation frames, and the mesh frames unless skinning on the GPU, of many model instances in parallel.
+    //Each instance is one job running createBakedFrame, which is createFrame unless the animation is baked, 
+    //followed by one job per mesh running getMeshFrame for the level of detail of the instance.
+    //When skinning on the GPU, the bone influence cap of the level of detail does not apply, see Lod::maxBoneInfluences.
+    //Instances with a level of detail updated less often keep their previous frames, see Lod::updateInterval.
+    //If frustum is given, the meshes with bounding boxes (see getBoundingBox) outside the frustum, placed by FrameJob::worldTransformation,
+    //are not skinned, see FrameJob::visibleMeshes.
+    //Returns when all the frames are created. Then draw each frame with FrameJob::draw on the OpenGL thread.
+    static void createFrames(JobSystem& jobSystem, std::vector<FrameJob>& frameJobs, const Frustum* frustum=nullptr) {
+        JobSystem::Counter counter;
+        for(unsigned int cj=0;cj<frameJobs.size();cj++) {
+            auto& frameJob=frameJobs[cj];
+            auto& model=*frameJob.model;
+            const auto& meshes=model.getLodMeshes(frameJob.lod);
+
+            //Distant instances keep their previous frame, see Lod::updateInterval
+            bool meshesChanged=!model.gpuSkinning && (frameJob.meshFrames.size()!=meshes.size() || 
+                               (meshes.size()>0 && &frameJob.meshFrames[0].mesh!=&meshes[0]));
+            unsigned int updateInterval=(frameJob.lod>0 && frameJob.lod<=model.lods.size()) ? model.lods[frameJob.lod-1].updateInterval : 1;
+            bool firstFrame=frameJob.framesSinceUpdate==std::numeric_limits<unsigned int>::max();
+            if(!firstFrame && !meshesChanged && ++frameJob.framesSinceUpdate<updateInterval)
+                continue;
+            //Spread the updates of new instances over the update interval
+            frameJob.framesSinceUpdate=firstFrame ? cj%std::max(updateInterval, 1u) : 0;
+
+            jobSystem.run(counter, [&jobSystem, &counter, &frameJob, &model, &meshes, frustum] {
+                model.createBakedFrame(frameJob.pose, frameJob.animationId, frameJob.time, frameJob.loop);
+                if(frustum) {
+                    frameJob.visibleMeshes.resize(meshes.size());
+                    frameJob.visible=false;
+                    for(unsigned int cm=0;cm<meshes.size();cm++) {
+                        BoundingBox boundingBox=model.getBoundingBox(frameJob.pose, meshes[cm]).transform(frameJob.worldTransformation);
+                        frameJob.visibleMeshes[cm]=frustum->intersects(boundingBox);
+                        frameJob.visible=frameJob.visible || frameJob.visibleMeshes[cm];
+                        SKELETAL_ANIMATION_MODEL_COUNT(MESHES_CULLED, !frameJob.visibleMeshes[cm]);
+                    }
+                }
+                else {
+                    frameJob.visibleMeshes.clear();
+                    frameJob.visible=true;
+                }
+                if(model.gpuSkinning)
+                    return;
+
+                auto& meshFrames=frameJob.meshFrames;
+                if(meshFrames.size()!=meshes.size() || (meshFrames.size()>0 && &meshFrames[0].mesh!=&meshes[0])) {
+                    meshFrames.clear();
+                    meshFrames.reserve(meshes.size());
+                    for(auto& mesh: meshes) {
+                        meshFrames.emplace_back(mesh);
+                        meshFrames.back().reuseIfUnchanged=true;
+                    }
+                }
+                for(unsigned int cm=0;cm<meshFrames.size();cm++) {
+                    if(!frameJob.visibleMeshes.empty() && !frameJob.visibleMeshes[cm])
+                        continue;
+                    auto& meshFrame=meshFrames[cm];
+                    jobSystem.run(counter, [&model, &frameJob, &meshFrame] {
+                        model.getMeshFrame(frameJob.pose, meshFrame, frameJob.lod);
+                    });
+                }
+            });
+        }
+        jobSystem.wait(counter);
+    }
+
+#ifndef SKELETAL_ANIMATION_MODEL_NO_GL
     //Convenient function to draw a frame directly without using createFrame, getMeshFrame, and drawMeshFrame separately. 
-    void drawFrame(unsigned int animationId, double time) {
+    //If frustum is given, in the space of the model, the meshes with bounding boxes outside it are neither skinned nor drawn, see getBoundingBox.
+    void drawFrame(unsigned int animationId, double time, const Frustum* frustum=nullptr) {
         createFrame(animationId, time);
-        for(auto& mesh: this->meshes) {
-            MeshFrame meshFrame=getMeshFrame(mesh);
-            drawMeshFrame(meshFrame);
+        auto visible=[this, frustum](const MeshType& mesh) {
+            if(!frustum)
+                return true;
+            bool intersects=frustum->intersects(getBoundingBox(mesh));
+            SKELETAL_ANIMATION_MODEL_COUNT(MESHES_CULLED, !intersects);
+            return intersects;
+        };
+        if(gpuSkinning) {
+            for(auto& mesh: this->meshes) {
+                if(visible(mesh))
+                    drawMeshFrame(mesh);
+            }
+        }
+        else {
+            //Mesh frames are reused between calls, and recreated if the meshes have changed or the model was copied
+            if(meshFrames.size()!=this->meshes.size() || (meshFrames.size()>0 && &meshFrames[0].mesh!=&this->meshes[0])) {
+                meshFrames.clear();
+                meshFrames.reserve(this->meshes.size());
+                for(auto& mesh: this->meshes) {
+                    meshFrames.emplace_back(mesh);
+                    meshFrames.back().reuseIfUnchanged=true;
+                }
+            }
+            for(auto& meshFrame: meshFrames) {
+                if(!visible(meshFrame.mesh))
+                    continue;
+                getMeshFrame(meshFrame);
+                drawMeshFrame(meshFrame);
+            }
         }
     }
+#endif
 
     //Read the 3D model
     virtual void read(const std::string& filename, unsigned int assimpImporterFlags=aiProcessPreset_TargetRealtime_Fast) {
@@ -276,22 +2770,97 @@ public:
         const aiScene *scene = importer.ReadFile(filename, assimpImporterFlags);
 
         if(scene) {
-            Model<MaterialType, MeshType>::read(scene);
-            read(scene);
+            readScene(scene, nullptr);
+            this->upload();
         }
     }
 
+    //Same as Model::upload, and uploads the meshes that can be skinned on the GPU if gpuSkinning is set
+    virtual void upload() {
+        Model<MaterialType, MeshType>::upload();
+#ifdef SKELETAL_ANIMATION_MODEL_GL_3_1
+        if(gpuSkinning)
+            createSkinningBuffers();
+#endif
+    }
+
+    //Writes the model, including bones, animations and baked animations (see bakeAnimations), to a binary file that readBaked can read without Assimp. 
+    //Typically written once after read, see baked_file.hpp.
+    virtual void writeBaked(const std::string& filename) const {
+        BakedWriter writer(filename);
+        Model<MaterialType, MeshType>::writeBaked(writer);
+        writeBaked(writer);
+        writer.close();
+    }
+
+    //Reads a model written by writeBaked. The file is memory mapped, and each array is copied with one memcpy.
+    //Returns false if the file could not be opened, and throws std::runtime_error if the file is invalid.
+    virtual bool readBaked(const std::string& filename) {
+        MappedFile file;
+        if(!file.open(filename))
+            return false;
+
+        BakedReader reader(file.data(), file.size());
+        Model<MaterialType, MeshType>::readBaked(reader);
+        readBaked(reader);
+        if(!this->readMeshes)
+            this->meshes.clear();
+        this->upload();
+        return true;
+    }
+
 protected:
+    //Same as Model::readScene, reading the materials and meshes with Model::read followed by the bones and animations with read
+    virtual void readScene(const aiScene *scene, JobSystem* jobSystem) {
+        Model<MaterialType, MeshType>::read(scene, jobSystem);
+        if(jobSystem)
+            read(scene, jobSystem);
+        else
+            read(scene);
+        if(this->optimizeMeshes) {
+            this->runJobs(jobSystem, this->meshes.size(), [this](size_t cm) {
+                optimizeMesh(this->meshes[cm]);
+            });
+        }
+    }
+
+    //Same as Model::optimizeMesh, and updates the vertex ids of the bone weights and the bone influences
+    virtual std::vector<unsigned int> optimizeMesh(MeshType& mesh) {
+        auto newVertexIds=Model<MaterialType, MeshType>::optimizeMesh(mesh);
+        for(auto& boneWeights: mesh.boneWeights) {
+            for(auto& weight: boneWeights.weights)
+                weight.mVertexId=newVertexIds[weight.mVertexId];
+        }
+        createBoneInfluences(mesh);
+        return newVertexIds;
+    }
+
+    //Reads the bones and animations without a job system, see read(const aiScene*, JobSystem*).
+    //Override read(const aiScene*, JobSystem*) instead to also be called by readAsync.
     virtual void read(const aiScene *scene) {
+        SkeletalAnimationModel::read(scene, nullptr);
+    }
+
+    //Reads the bones and animations. The bone weights of each mesh are read as parallel jobs if jobSystem is given.
+    virtual void read(const aiScene *scene, JobSystem* jobSystem) {
+        //The nodes by name, found in one pass instead of searching the node tree for each channel and bone
+        std::unordered_map<std::string, const aiNode*> nodes;
+        addNodes(scene->mRootNode, nodes);
+        //Each bone is a node, so the bones are allocated once
+        bones.reserve(nodes.size());
+        boneNames.reserve(nodes.size());
+        boneName2boneId.reserve(nodes.size());
+
         //Find channels, and the bones used in the channels
+        animations.reserve(scene->mNumAnimations);
         for(unsigned int ca=0;ca<scene->mNumAnimations;ca++) {
-            animations.emplace_back();
+            animations.emplace_back(animations.get_allocator());
             auto& animation=animations[ca];
 
             animation.duration=scene->mAnimations[ca]->mDuration;
             animation.ticksPerSecond=scene->mAnimations[ca]->mTicksPerSecond;
 
-            animation.channels.resize(scene->mAnimations[ca]->mNumChannels);
+            resizeWithAllocator(animation.channels, scene->mAnimations[ca]->mNumChannels);
             for(unsigned int cc=0;cc<scene->mAnimations[ca]->mNumChannels;cc++) {
                 animation.channels[cc].positions.resize(scene->mAnimations[ca]->mChannels[cc]->mNumPositionKeys);
                 animation.channels[cc].scales.resize(scene->mAnimations[ca]->mChannels[cc]->mNumScalingKeys);
@@ -307,31 +2876,35 @@ protected:
                     animation.channels[cc].rotations[cr]=scene->mAnimations[ca]->mChannels[cc]->mRotationKeys[cr];
                 }
 
-                const aiNode* node=scene->mRootNode->FindNode(scene->mAnimations[ca]->mChannels[cc]->mNodeName);
+                const aiNode* node=findNode(nodes, scene->mAnimations[ca]->mChannels[cc]->mNodeName);
                 animations[ca].channels[cc].boneId=getBoneId(node);
             }
         }
 
-        //Find all the bones, and their parent bones, connected to the meshes
+        //Find all the bones, and their parent bones, connected to the meshes.
+        //The bones are found even if the meshes are not read, see Model::readMeshes.
         for(unsigned int cm=0;cm<scene->mNumMeshes;cm++) {
+            if(this->readMeshes)
+                this->meshes[cm].boneWeights.reserve(scene->mMeshes[cm]->mNumBones);
             for(unsigned int cb=0;cb<scene->mMeshes[cm]->mNumBones;cb++) {
-                const aiNode* node=scene->mRootNode->FindNode(scene->mMeshes[cm]->mBones[cb]->mName);                    
-                this->meshes[cm].boneWeights.emplace_back();
+                const aiNode* node=findNode(nodes, scene->mMeshes[cm]->mBones[cb]->mName);
                 unsigned int boneId=getBoneId(node);
-                this->meshes[cm].boneWeights[cb].boneId=boneId;
-                this->meshes[cm].boneWeights[cb].offsetMatrix=scene->mMeshes[cm]->mBones[cb]->mOffsetMatrix;
-
-                for(unsigned int cw=0;cw<scene->mMeshes[cm]->mBones[cb]->mNumWeights;cw++) {
-                    this->meshes[cm].boneWeights[cb].weights.emplace_back(scene->mMeshes[cm]->mBones[cb]->mWeights[cw]);
+                if(this->readMeshes) {
+                    this->meshes[cm].boneWeights.emplace_back(this->meshes[cm].boneWeights.get_allocator());
+                    this->meshes[cm].boneWeights[cb].boneId=boneId;
+                    this->meshes[cm].boneWeights[cb].offsetMatrix=scene->mMeshes[cm]->mBones[cb]->mOffsetMatrix;
+                    this->meshes[cm].boneWeights[cb].offsetTransformation=AffineTransformation(scene->mMeshes[cm]->mBones[cb]->mOffsetMatrix);
                 }
 
                 if(!bones[boneId].hasParentBoneId) {
-                    //Populate Bone::parentBoneIds
+                    //Populate Bone::parentBoneIds, stopping at a bone whose parent bones are already found
                     node=node->mParent;
                     while(node!=scene->mRootNode) {
                         unsigned int parentBoneId=getBoneId(node);
                         bones[boneId].parentBoneId=parentBoneId;
                         bones[boneId].hasParentBoneId=true;
+                        if(bones[parentBoneId].hasParentBoneId)
+                            break;
                         boneId=parentBoneId;
 
                         node=node->mParent;
@@ -339,6 +2912,160 @@ protected:
                 }
             }
         }
+
+        sortBones();
+        createRestPose();
+        updateGlobalBoneTransformations();
+
+        //Read the vertex weights, one job per mesh
+        this->runJobs(jobSystem, this->meshes.size(), [this, scene](size_t cm) {
+            for(unsigned int cb=0;cb<scene->mMeshes[cm]->mNumBones;cb++) {
+                const aiBone* bone=scene->mMeshes[cm]->mBones[cb];
+                this->meshes[cm].boneWeights[cb].weights.assign(bone->mWeights, bone->mWeights+bone->mNumWeights);
+            }
+            createBoneInfluences(this->meshes[cm]);
+            createBoneBoundingBoxes(this->meshes[cm]);
+        });
+    }
+
+    virtual void writeBaked(BakedWriter& writer) const {
+        writer.write<uint64_t>(bones.size());
+        for(auto& bone: bones) {
+            writer.write(bone.transformation);
+            writer.write<uint32_t>(bone.parentBoneId);
+            writer.write<uint8_t>(bone.hasParentBoneId);
+        }
+        writer.write<uint64_t>(boneName2boneId.size());
+        for(auto& p: boneName2boneId) {
+            writer.writeString(p.first);
+            writer.write<uint32_t>(p.second);
+        }
+
+        for(auto& mesh: this->meshes) {
+            writer.write<uint64_t>(mesh.boneWeights.size());
+            for(auto& boneWeights: mesh.boneWeights) {
+                writer.write<uint32_t>(boneWeights.boneId);
+                writer.write(boneWeights.offsetMatrix);
+                writer.writeArray(boneWeights.weights);
+            }
+            writer.writeArray(mesh.boneInfluenceIds);
+            writer.writeArray(mesh.boneInfluenceWeights);
+            writer.write<uint32_t>(mesh.maxBoneWeightsPerVertex);
+        }
+
+        writer.write<uint64_t>(animations.size());
+        for(auto& animation: animations) {
+            writer.write(animation.duration);
+            writer.write(animation.ticksPerSecond);
+            writer.write<uint64_t>(animation.channels.size());
+            for(auto& channel: animation.channels) {
+                writer.write<uint32_t>(channel.boneId);
+                writer.writeArray(channel.positions);
+                writer.writeArray(channel.rotations);
+                writer.writeArray(channel.scales);
+                writer.writeArray(channel.compressedPositions);
+                writer.writeArray(channel.compressedRotations);
+                writer.writeArray(channel.compressedScales);
+            }
+        }
+
+        writer.write<uint64_t>(bakedAnimations.size());
+        for(auto& bakedAnimation: bakedAnimations) {
+            writer.write(bakedAnimation.framesPerSecond);
+            writer.write(bakedAnimation.duration);
+            writer.write<uint32_t>(bakedAnimation.numBones);
+            writer.writeArray(bakedAnimation.frames);
+        }
+    }
+
+    //Replaces the bones, bone weights and animations of the model. Throws std::runtime_error if they are invalid.
+    virtual void readBaked(BakedReader& reader) {
+        bones.clear();
+        boneName2boneId.clear();
+        animations.clear();
+        bakedAnimations.clear();
+
+        bones.resize(reader.readCount(sizeof(aiMatrix4x4)+sizeof(uint32_t)+sizeof(uint8_t)));
+        for(auto& bone: bones) {
+            bone.transformation=reader.read<aiMatrix4x4>();
+            bone.parentBoneId=reader.read<uint32_t>();
+            bone.hasParentBoneId=reader.read<uint8_t>();
+            if(bone.hasParentBoneId && bone.parentBoneId>=static_cast<unsigned int>(&bone-&bones[0]))
+                throw std::runtime_error("SkeletalAnimationModel::readBaked: invalid bone hierarchy");
+        }
+        uint64_t numBoneNames=reader.readCount(sizeof(uint64_t)+sizeof(uint32_t));
+        for(uint64_t cb=0;cb<numBoneNames;cb++) {
+            std::string boneName=reader.readString();
+            boneName2boneId[boneName]=reader.read<uint32_t>();
+        }
+        boneNames.assign(bones.size(), std::string());
+        for(auto& p: boneName2boneId) {
+            if(p.second>=bones.size())
+                throw std::runtime_error("SkeletalAnimationModel::readBaked: invalid bone name");
+            boneNames[p.second]=p.first;
+        }
+
+        for(auto& mesh: this->meshes) {
+            resizeWithAllocator(mesh.boneWeights, reader.readCount(sizeof(uint32_t)+sizeof(aiMatrix4x4)+sizeof(uint64_t)));
+            for(auto& boneWeights: mesh.boneWeights) {
+                boneWeights.boneId=reader.read<uint32_t>();
+                boneWeights.offsetMatrix=reader.read<aiMatrix4x4>();
+                boneWeights.offsetTransformation=AffineTransformation(boneWeights.offsetMatrix);
+                reader.readArray(boneWeights.weights);
+                if(boneWeights.boneId>=bones.size() || 
+                   std::any_of(boneWeights.weights.begin(), boneWeights.weights.end(), [&mesh](const aiVertexWeight& weight) {
+                       return weight.mVertexId>=mesh.vertices.size();
+                   }))
+                    throw std::runtime_error("SkeletalAnimationModel::readBaked: invalid bone weights");
+            }
+            reader.readArray(mesh.boneInfluenceIds);
+            reader.readArray(mesh.boneInfluenceWeights);
+            mesh.maxBoneWeightsPerVertex=reader.read<uint32_t>();
+            //The influences of meshes without bone weights have bone id 0
+            size_t numBoneIds=std::max<size_t>(mesh.boneWeights.size(), 1);
+            if(mesh.boneInfluenceIds.size()!=mesh.vertices.size()*4 || mesh.boneInfluenceWeights.size()!=mesh.vertices.size()*4 ||
+               std::any_of(mesh.boneInfluenceIds.begin(), mesh.boneInfluenceIds.end(), [numBoneIds](uint16_t boneId) {
+                   return boneId>=numBoneIds;
+               }))
+                throw std::runtime_error("SkeletalAnimationModel::readBaked: invalid bone influences");
+            createBoneBoundingBoxes(mesh);
+        }
+
+        resizeWithAllocator(animations, reader.readCount(2*sizeof(double)+sizeof(uint64_t)));
+        for(auto& animation: animations) {
+            animation.duration=reader.read<double>();
+            animation.ticksPerSecond=reader.read<double>();
+            resizeWithAllocator(animation.channels, reader.readCount(sizeof(uint32_t)+6*sizeof(uint64_t)));
+            for(auto& channel: animation.channels) {
+                channel.boneId=reader.read<uint32_t>();
+                reader.readArray(channel.positions);
+                reader.readArray(channel.rotations);
+                reader.readArray(channel.scales);
+                reader.readArray(channel.compressedPositions);
+                reader.readArray(channel.compressedRotations);
+                reader.readArray(channel.compressedScales);
+                //Sampling requires at least one key of each kind, see Animation::interpolate
+                bool hasKeys=channel.compressed() ? 
+                             !channel.compressedPositions.empty() && !channel.compressedRotations.empty() && !channel.compressedScales.empty() :
+                             !channel.positions.empty() && !channel.rotations.empty() && !channel.scales.empty();
+                if(channel.boneId>=bones.size() || !hasKeys)
+                    throw std::runtime_error("SkeletalAnimationModel::readBaked: invalid animation channel");
+            }
+        }
+
+        bakedAnimations.resize(reader.readCount(2*sizeof(double)+sizeof(uint32_t)+sizeof(uint64_t)));
+        for(auto& bakedAnimation: bakedAnimations) {
+            bakedAnimation.framesPerSecond=reader.read<double>();
+            bakedAnimation.duration=reader.read<double>();
+            bakedAnimation.numBones=reader.read<uint32_t>();
+            reader.readArray(bakedAnimation.frames);
+            if(!bakedAnimation.frames.empty() && (bakedAnimation.numBones!=bones.size() || bakedAnimation.frames.size()%bakedAnimation.numBones!=0 ||
+                                                  !(bakedAnimation.duration>0.0) || !(bakedAnimation.framesPerSecond>0.0)))
+                throw std::runtime_error("SkeletalAnimationModel::readBaked: invalid baked animation");
+        }
+
+        createRestPose();
+        updateGlobalBoneTransformations();
     }
 };
 
@@ -0,0 +1,682 @@
+#include "skeletal_animation_model.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+//The GPU backends skin into BufferFrames, which need the OpenGL 3.1 declarations, see SKELETAL_ANIMATION_MODEL_GL_3_1
+#if defined(SKINNING_REGRESSION_GPU) && !defined(SKELETAL_ANIMATION_MODEL_GL_3_1)
+#undef SKINNING_REGRESSION_GPU
+#endif
+
+#ifdef SKINNING_REGRESSION_GPU
+#include <SFML/Window.hpp>
+#endif
+
+//Correctness and performance regression harness of the skinning backends of SkeletalAnimationModel.
+//Each animation of each model is sampled at fixed times, the frames of its baked animation (see SkeletalAnimationModel::bakeAnimations)
+//and a quarter frame after them, and the vertices and normals of each backend are compared with a double precision reference within the given tolerances.
+//Between the frames, the baked backend interpolates the bone matrices of the frames before and after, and is compared with its own tolerances.
+//The throughput of each backend is measured on one thread, and everything is written to a JSON report.
+//Returns 1 if a backend does not match its reference, for instance in continuous integration.
+//Built as skinning_regression, and as skinning_regression_scalar without SSE or NEON (see SKELETAL_ANIMATION_MODEL_NO_SIMD).
+//The GPU backends are included if built with SFML, which creates the OpenGL context. Run without arguments for usage.
+
+class Options {
+public:
+    std::vector<std::string> models;
+    //Empty to write no report
+    std::string reportFilename;
+    //Samples per animation at evenly spaced frames of the baked animation, and as many between frames
+    unsigned int numSamples=16;
+    double framesPerSecond=30.0;
+    //Largest position error relative to the diagonal of the bind-pose bounding box of the model
+    double positionTolerance=1e-5;
+    //Largest difference between the normalized normals
+    double normalTolerance=1e-4;
+    //Tolerances of the baked backend between frames, where the interpolated bone matrices differ from the sampled ones.
+    //For the default frames per second: the errors shrink about quadratically with the frame rate.
+    double interpolatedPositionTolerance=3e-2;
+    double interpolatedNormalTolerance=3e-1;
+    //Minimum time each backend is measured
+    double minSeconds=0.5;
+    bool gpu=true;
+};
+
+void printUsage() {
+    std::printf("Usage: skinning_regression [options] [model file]...\n"
+                "Compares the skinning backends with double precision references on the given models\n"
+                "(default models/astroBoy_walk_Max.dae and models/astroBoy_walk_Maya.dae), and measures their throughput\n"
+                "Options:\n"
+                "  -o <file>                  write a JSON report to file\n"
+                "  -samples <count>           samples per animation (default 16)\n"
+                "  -fps <rate>                frames per second of the baked animations (default 30)\n"
+                "  -position-tolerance <tol>  largest position error relative to the model size (default 1e-5)\n"
+                "  -normal-tolerance <tol>    largest normal error (default 1e-4)\n"
+                "  -interpolated-position-tolerance <tol>\n"
+                "                             largest position error of the baked backend between frames (default 3e-2)\n"
+                "  -interpolated-normal-tolerance <tol>\n"
+                "                             largest normal error of the baked backend between frames (default 3e-1)\n"
+                "  -seconds <time>            minimum time each backend is measured (default 0.5)\n"
+                "  -no-gpu                    skip the GPU backends\n");
+}
+
+//Returns false if the arguments are invalid
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for(int ca=1;ca<argc;ca++) {
+        std::string argument=argv[ca];
+        bool hasValue=ca+1<argc;
+        if(argument=="-o" && hasValue)
+            options.reportFilename=argv[++ca];
+        else if(argument=="-samples" && hasValue)
+            options.numSamples=std::atoi(argv[++ca]);
+        else if(argument=="-fps" && hasValue)
+            options.framesPerSecond=std::atof(argv[++ca]);
+        else if(argument=="-position-tolerance" && hasValue)
+            options.positionTolerance=std::atof(argv[++ca]);
+        else if(argument=="-normal-tolerance" && hasValue)
+            options.normalTolerance=std::atof(argv[++ca]);
+        else if(argument=="-interpolated-position-tolerance" && hasValue)
+            options.interpolatedPositionTolerance=std::atof(argv[++ca]);
+        else if(argument=="-interpolated-normal-tolerance" && hasValue)
+            options.interpolatedNormalTolerance=std::atof(argv[++ca]);
+        else if(argument=="-seconds" && hasValue)
+            options.minSeconds=std::atof(argv[++ca]);
+        else if(argument=="-no-gpu")
+            options.gpu=false;
+        else if(!argument.empty() && argument[0]=='-')
+            return false;
+        else
+            options.models.emplace_back(argument);
+    }
+    if(options.models.empty())
+        options.models={"models/astroBoy_walk_Max.dae", "models/astroBoy_walk_Maya.dae"};
+    return options.numSamples>0 && options.framesPerSecond>0.0;
+}
+
+typedef SkeletalAnimationModel<> SkinnedModel;
+
+//Skinned vertices and normals of each mesh of a model in double precision
+class ReferenceFrame {
+public:
+    std::vector<std::vector<double> > vertices;
+    std::vector<std::vector<double> > normals;
+};
+
+//Row major 3x4 matrix m of the global transformation times the offset matrix of a bone
+void boneMatrix(const aiMatrix4x4& globalTransformation, const aiMatrix4x4& offsetMatrix, double* m) {
+    const float* gRows[4]={&globalTransformation.a1, &globalTransformation.b1, &globalTransformation.c1, &globalTransformation.d1};
+    const float* oRows[4]={&offsetMatrix.a1, &offsetMatrix.b1, &offsetMatrix.c1, &offsetMatrix.d1};
+    for(unsigned int r=0;r<3;r++) {
+        for(unsigned int c=0;c<4;c++) {
+            m[r*4+c]=0.0;
+            for(unsigned int k=0;k<4;k++)
+                m[r*4+c]+=static_cast<double>(gRows[r][k])*oRows[k][c];
+        }
+    }
+}
+
+//Unit dual quaternion in double precision, with the layout of DualQuaternion
+class ReferenceDualQuaternion {
+public:
+    double real[4];
+    double dual[4];
+
+    //Rotation of the row major 3x4 matrix m with the scale of each column removed, and its translation.
+    //Computed independently of DualQuaternion(const AffineTransformation&), which it checks.
+    explicit ReferenceDualQuaternion(const double* m) {
+        double scales[3];
+        for(unsigned int c=0;c<3;c++) {
+            scales[c]=std::sqrt(m[c]*m[c]+m[4+c]*m[4+c]+m[8+c]*m[8+c]);
+            if(scales[c]==0.0)
+                scales[c]=1.0;
+        }
+        double r[3][3];
+        for(unsigned int cr=0;cr<3;cr++) {
+            for(unsigned int cc=0;cc<3;cc++)
+                r[cr][cc]=m[cr*4+cc]/scales[cc];
+        }
+        //The largest of 4w^2, 4x^2, 4y^2 and 4z^2 is computed from the diagonal, and the others from the off-diagonal elements
+        double squares[4]={1.0+r[0][0]-r[1][1]-r[2][2], 1.0-r[0][0]+r[1][1]-r[2][2], 1.0-r[0][0]-r[1][1]+r[2][2], 1.0+r[0][0]+r[1][1]+r[2][2]};
+        unsigned int largest=std::max_element(squares, squares+4)-squares;
+        double s=0.5/std::sqrt(std::max(squares[largest], 1e-300));
+        double differences[3]={r[2][1]-r[1][2], r[0][2]-r[2][0], r[1][0]-r[0][1]};
+        double sums[3]={r[2][1]+r[1][2], r[0][2]+r[2][0], r[1][0]+r[0][1]};
+        if(largest==3) {
+            for(unsigned int c=0;c<3;c++)
+                real[c]=differences[c]*s;
+        }
+        else {
+            real[largest]=0.0;
+            //sums[c] is 4 times the product of the two components other than c
+            for(unsigned int c=0;c<3;c++) {
+                if(c!=largest)
+                    real[c]=sums[3-largest-c]*s;
+            }
+            real[3]=differences[largest]*s;
+        }
+        real[largest]=squares[largest]*s;
+
+        //dual=0.5*translation*real, with translation as a quaternion with w=0
+        double t[3]={m[3], m[7], m[11]};
+        dual[0]=0.5*(t[0]*real[3]+t[1]*real[2]-t[2]*real[1]);
+        dual[1]=0.5*(-t[0]*real[2]+t[1]*real[3]+t[2]*real[0]);
+        dual[2]=0.5*(t[0]*real[1]-t[1]*real[0]+t[2]*real[3]);
+        dual[3]=-0.5*(t[0]*real[0]+t[1]*real[1]+t[2]*real[2]);
+    }
+};
+
+//Linear blend skinning of each mesh, accumulating all the bone weights of each vertex
+void skinLinearReference(const SkinnedModel& model, const Pose& pose, ReferenceFrame& frame) {
+    frame.vertices.resize(model.meshes.size());
+    frame.normals.resize(model.meshes.size());
+    for(unsigned int cm=0;cm<model.meshes.size();cm++) {
+        const auto& mesh=model.meshes[cm];
+        auto& vertices=frame.vertices[cm];
+        auto& normals=frame.normals[cm];
+        vertices.assign(mesh.vertices.size()*3, 0.0);
+        normals.assign(mesh.vertices.size()*3, 0.0);
+        for(auto& boneWeights: mesh.boneWeights) {
+            double m[12];
+            boneMatrix(pose.globalTransformations[boneWeights.boneId], boneWeights.offsetMatrix, m);
+            for(auto& weight: boneWeights.weights) {
+                const aiVector3D& vertex=mesh.vertices[weight.mVertexId];
+                const aiVector3D& normal=mesh.normals[weight.mVertexId];
+                for(unsigned int r=0;r<3;r++) {
+                    vertices[weight.mVertexId*3+r]+=weight.mWeight*(m[r*4]*vertex.x+m[r*4+1]*vertex.y+m[r*4+2]*vertex.z+m[r*4+3]);
+                    normals[weight.mVertexId*3+r]+=weight.mWeight*(m[r*4]*normal.x+m[r*4+1]*normal.y+m[r*4+2]*normal.z);
+                }
+            }
+        }
+    }
+}
+
+//Dual quaternion skinning of each mesh with the 4 bone influences per vertex, as skinBoneInfluencesDualQuaternion,
+//with the bone dual quaternions converted from the bone matrices in double precision
+void skinDualQuaternionReference(const SkinnedModel& model, const Pose& pose, ReferenceFrame& frame) {
+    frame.vertices.resize(model.meshes.size());
+    frame.normals.resize(model.meshes.size());
+    std::vector<ReferenceDualQuaternion> palette;
+    for(unsigned int cm=0;cm<model.meshes.size();cm++) {
+        const auto& mesh=model.meshes[cm];
+        auto& vertices=frame.vertices[cm];
+        auto& normals=frame.normals[cm];
+        vertices.assign(mesh.vertices.size()*3, 0.0);
+        normals.assign(mesh.vertices.size()*3, 0.0);
+        palette.clear();
+        for(auto& boneWeights: mesh.boneWeights) {
+            double m[12];
+            boneMatrix(pose.globalTransformations[boneWeights.boneId], boneWeights.offsetMatrix, m);
+            palette.emplace_back(m);
+        }
+        if(palette.empty())
+            continue;
+
+        for(unsigned int cv=0;cv<mesh.vertices.size();cv++) {
+            const ReferenceDualQuaternion& first=palette[mesh.boneInfluenceIds[cv*4]];
+            double real[4]={}, dual[4]={};
+            for(unsigned int ci=0;ci<4;ci++) {
+                const ReferenceDualQuaternion& q=palette[mesh.boneInfluenceIds[cv*4+ci]];
+                double weight=mesh.boneInfluenceWeights[cv*4+ci];
+                //q and -q are the same rotation
+                if(first.real[0]*q.real[0]+first.real[1]*q.real[1]+first.real[2]*q.real[2]+first.real[3]*q.real[3]<0.0)
+                    weight=-weight;
+                for(unsigned int c=0;c<4;c++) {
+                    real[c]+=weight*q.real[c];
+                    dual[c]+=weight*q.dual[c];
+                }
+            }
+            double length=std::sqrt(real[0]*real[0]+real[1]*real[1]+real[2]*real[2]+real[3]*real[3]);
+            if(length==0.0)
+                continue;
+            for(unsigned int c=0;c<4;c++) {
+                real[c]/=length;
+                dual[c]/=length;
+            }
+
+            //Rotates v by real, see DualQuaternion::transformNormal
+            auto rotate=[&real](const aiVector3D& v, double* out) {
+                double x=real[1]*v.z-real[2]*v.y+real[3]*v.x;
+                double y=real[2]*v.x-real[0]*v.z+real[3]*v.y;
+                double z=real[0]*v.y-real[1]*v.x+real[3]*v.z;
+                out[0]=v.x+2.0*(real[1]*z-real[2]*y);
+                out[1]=v.y+2.0*(real[2]*x-real[0]*z);
+                out[2]=v.z+2.0*(real[0]*y-real[1]*x);
+            };
+            rotate(mesh.vertices[cv], &vertices[cv*3]);
+            rotate(mesh.normals[cv], &normals[cv*3]);
+            vertices[cv*3]+=2.0*(real[3]*dual[0]-dual[3]*real[0]+real[1]*dual[2]-real[2]*dual[1]);
+            vertices[cv*3+1]+=2.0*(real[3]*dual[1]-dual[3]*real[1]+real[2]*dual[0]-real[0]*dual[2]);
+            vertices[cv*3+2]+=2.0*(real[3]*dual[2]-dual[3]*real[2]+real[0]*dual[1]-real[1]*dual[0]);
+        }
+    }
+}
+
+//Animation and time at which the backends are compared with the references
+class Sample {
+public:
+    unsigned int animationId;
+    double time;
+    //A quarter frame after a frame of the baked animation
+    bool betweenFrames;
+
+    Sample(unsigned int animationId, double time, bool betweenFrames) : animationId(animationId), time(time), betweenFrames(betweenFrames) {}
+};
+
+//A way to skin the meshes of a model, compared with the reference given by dualQuaternion
+class Backend {
+public:
+    std::string name;
+    bool dualQuaternion=false;
+    //Interpolates the frames of the baked animations, and is compared with the interpolated tolerances between frames
+    bool baked=false;
+    //Creates the pose of the given animation and time
+    std::function<void(unsigned int animationId, double time)> createPose;
+    //Skins all the meshes of the pose, and waits until they are skinned
+    std::function<void()> skin;
+    //Copies the skinned vertices and normals of the given mesh
+    std::function<void(unsigned int meshId, std::vector<aiVector3D>& vertices, std::vector<aiVector3D>& normals)> getMeshFrame;
+};
+
+//Comparison and throughput of one backend on one model
+class Result {
+public:
+    std::string backend;
+    std::string reference;
+    unsigned int numSamples=0;
+    double maxPositionError=0.0;
+    double maxNormalError=0.0;
+    //Samples between frames of a baked backend, not counted in numSamples
+    unsigned int numInterpolatedSamples=0;
+    double maxInterpolatedPositionError=0.0;
+    double maxInterpolatedNormalError=0.0;
+    bool passed=true;
+
+    double verticesPerSecond=0.0;
+    //Instances, each a pose and its skinned meshes, created per 60 Hz frame on one thread
+    double instancesPerFrame=0.0;
+};
+
+class ModelReport {
+public:
+    std::string filename;
+    std::string error;
+    size_t numMeshes=0;
+    size_t numVertices=0;
+    size_t numBones=0;
+    size_t numAnimations=0;
+    //Diagonal of the bind-pose bounding box, the unit of the position errors
+    double size=0.0;
+    std::vector<Result> results;
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+//Largest distance between the position and between the normalized normal of the vertices and the reference
+void compare(const std::vector<aiVector3D>& vertices, const std::vector<aiVector3D>& normals,
+             const std::vector<double>& referenceVertices, const std::vector<double>& referenceNormals,
+             double& maxPositionError, double& maxNormalError) {
+    for(unsigned int cv=0;cv<vertices.size() && cv*3<referenceVertices.size();cv++) {
+        const double* referenceVertex=&referenceVertices[cv*3];
+        double dx=vertices[cv].x-referenceVertex[0], dy=vertices[cv].y-referenceVertex[1], dz=vertices[cv].z-referenceVertex[2];
+        maxPositionError=std::max(maxPositionError, std::sqrt(dx*dx+dy*dy+dz*dz));
+
+        const double* referenceNormal=&referenceNormals[cv*3];
+        double length=std::sqrt(normals[cv].x*normals[cv].x+normals[cv].y*normals[cv].y+normals[cv].z*normals[cv].z);
+        double referenceLength=std::sqrt(referenceNormal[0]*referenceNormal[0]+referenceNormal[1]*referenceNormal[1]+referenceNormal[2]*referenceNormal[2]);
+        if(length==0.0 || referenceLength==0.0) {
+            length=1.0;
+            referenceLength=1.0;
+        }
+        double nx=normals[cv].x/length-referenceNormal[0]/referenceLength;
+        double ny=normals[cv].y/length-referenceNormal[1]/referenceLength;
+        double nz=normals[cv].z/length-referenceNormal[2]/referenceLength;
+        maxNormalError=std::max(maxNormalError, std::sqrt(nx*nx+ny*ny+nz*nz));
+    }
+}
+
+//Backends skinning on the CPU into mesh frames, with meshes meshes of model
+Backend cpuBackend(const std::string& name, const SkinnedModel& model, const std::vector<MeshExtended>& meshes, bool baked) {
+    auto pose=std::make_shared<Pose>(model.createPose());
+    auto meshFrames=std::make_shared<std::vector<SkinnedModel::MeshFrame> >();
+    for(auto& mesh: meshes)
+        meshFrames->emplace_back(mesh);
+
+    Backend backend;
+    backend.name=name;
+    backend.dualQuaternion=model.dualQuaternionSkinning;
+    backend.baked=baked;
+    backend.createPose=[&model, pose, baked](unsigned int animationId, double time) {
+        if(baked)
+            model.createBakedFrame(*pose, animationId, time);
+        else
+            model.createFrame(*pose, animationId, time);
+    };
+    backend.skin=[&model, pose, meshFrames] {
+        for(auto& meshFrame: *meshFrames)
+            model.getMeshFrame(*pose, meshFrame);
+    };
+    backend.getMeshFrame=[meshFrames](unsigned int meshId, std::vector<aiVector3D>& vertices, std::vector<aiVector3D>& normals) {
+        vertices=(*meshFrames)[meshId].vertices;
+        normals=(*meshFrames)[meshId].normals;
+    };
+    return backend;
+}
+
+#ifdef SKINNING_REGRESSION_GPU
+//Backend skinning into buffer frames with transform feedback, see SkeletalAnimationModel::getMeshFrame taking a BufferFrame
+Backend gpuBackend(const std::string& name, const SkinnedModel& model) {
+    auto pose=std::make_shared<Pose>(model.createPose());
+    auto bufferFrames=std::make_shared<std::vector<SkinnedModel::BufferFrame> >();
+    for(auto& mesh: model.meshes)
+        bufferFrames->emplace_back(mesh);
+
+    Backend backend;
+    backend.name=name;
+    backend.dualQuaternion=model.dualQuaternionSkinning;
+    backend.createPose=[&model, pose](unsigned int animationId, double time) {
+        model.createFrame(*pose, animationId, time);
+    };
+    backend.skin=[&model, pose, bufferFrames] {
+        for(auto& bufferFrame: *bufferFrames)
+            model.getMeshFrame(*pose, bufferFrame);
+        glFinish();
+    };
+    backend.getMeshFrame=[bufferFrames](unsigned int meshId, std::vector<aiVector3D>& vertices, std::vector<aiVector3D>& normals) {
+        const auto& bufferFrame=(*bufferFrames)[meshId];
+        const auto& format=bufferFrame.vertexFormat;
+        std::vector<unsigned char> data(bufferFrame.bufferSize);
+        glBindBuffer(GL_ARRAY_BUFFER, bufferFrame.vertexBuffer.id());
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, data.size(), data.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        size_t numVertices=std::min(bufferFrame.mesh.vertices.size(), data.size()/format.size);
+        vertices.resize(numVertices);
+        normals.resize(numVertices);
+        for(size_t cv=0;cv<numVertices;cv++) {
+            std::memcpy(&vertices[cv], &data[cv*format.size], sizeof(aiVector3D));
+            std::memcpy(&normals[cv], &data[cv*format.size+format.normalOffset], sizeof(aiVector3D));
+        }
+    };
+    return backend;
+}
+
+//Returns true if the current OpenGL context supports transform feedback
+bool hasTransformFeedback() {
+    const char* version=reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    return version && std::atoi(version)>=3;
+}
+#endif
+
+//Compares backend with the references at each sample, then measures its throughput
+Result run(const Options& options, Backend& backend, const std::vector<Sample>& samples,
+           const std::vector<ReferenceFrame>& linearReferences, const std::vector<ReferenceFrame>& dualQuaternionReferences,
+           size_t numVertices, double size) {
+    Result result;
+    result.backend=backend.name;
+    result.reference=backend.dualQuaternion ? "dual_quaternion" : "linear";
+    std::vector<aiVector3D> vertices, normals;
+    for(unsigned int cs=0;cs<samples.size();cs++) {
+        backend.createPose(samples[cs].animationId, samples[cs].time);
+        backend.skin();
+        const auto& reference=backend.dualQuaternion ? dualQuaternionReferences[cs] : linearReferences[cs];
+        bool interpolated=backend.baked && samples[cs].betweenFrames;
+        for(unsigned int cm=0;cm<reference.vertices.size();cm++) {
+            backend.getMeshFrame(cm, vertices, normals);
+            if(interpolated)
+                compare(vertices, normals, reference.vertices[cm], reference.normals[cm], result.maxInterpolatedPositionError, result.maxInterpolatedNormalError);
+            else
+                compare(vertices, normals, reference.vertices[cm], reference.normals[cm], result.maxPositionError, result.maxNormalError);
+        }
+        if(interpolated)
+            result.numInterpolatedSamples++;
+        else
+            result.numSamples++;
+    }
+    if(size>0.0) {
+        result.maxPositionError/=size;
+        result.maxInterpolatedPositionError/=size;
+    }
+    result.passed=result.maxPositionError<=options.positionTolerance && result.maxNormalError<=options.normalTolerance &&
+                  result.maxInterpolatedPositionError<=options.interpolatedPositionTolerance &&
+                  result.maxInterpolatedNormalError<=options.interpolatedNormalTolerance;
+
+    double poseSeconds=0.0, skinSeconds=0.0;
+    size_t numFrames=0;
+    auto start=std::chrono::steady_clock::now();
+    while(numFrames<samples.size() || secondsSince(start)<options.minSeconds) {
+        const auto& sample=samples[numFrames%samples.size()];
+        //Offset the time of each pass, so that the frames are not skipped as unchanged, see FrameKey
+        double time=sample.time+1e-3*(numFrames/samples.size()%2);
+        auto poseStart=std::chrono::steady_clock::now();
+        backend.createPose(sample.animationId, time);
+        auto skinStart=std::chrono::steady_clock::now();
+        backend.skin();
+        skinSeconds+=secondsSince(skinStart);
+        poseSeconds+=std::chrono::duration<double>(skinStart-poseStart).count();
+        numFrames++;
+    }
+    if(skinSeconds>0.0)
+        result.verticesPerSecond=numFrames*numVertices/skinSeconds;
+    if(poseSeconds+skinSeconds>0.0)
+        result.instancesPerFrame=numFrames/(poseSeconds+skinSeconds)/60.0;
+    return result;
+}
+
+void runModel(const Options& options, bool gpu, ModelReport& report) {
+    SkinnedModel model;
+    model.read(report.filename);
+    if(model.meshes.empty() || model.bones.empty()) {
+        report.error="could not read model";
+        return;
+    }
+    model.bakeAnimations(options.framesPerSecond);
+
+    report.numMeshes=model.meshes.size();
+    BoundingBox boundingBox;
+    for(auto& mesh: model.meshes) {
+        report.numVertices+=mesh.vertices.size();
+        for(auto& vertex: mesh.vertices)
+            boundingBox.add(vertex);
+    }
+    report.numBones=model.bones.size();
+    report.numAnimations=model.animations.size();
+    if(!boundingBox.empty())
+        report.size=(boundingBox.max-boundingBox.min).Length();
+
+    //Evenly spaced frames of each baked animation, so that the baked backend is compared at its frames without interpolation,
+    //and a quarter frame after evenly spaced frames, where it interpolates. Not halfway, where swapping the frames before and after
+    //would go unnoticed. The last frame is skipped: when looping it is followed by the first frame, which only matches the animation
+    //at its duration if the animation loops seamlessly.
+    std::vector<Sample> samples;
+    for(unsigned int ca=0;ca<model.animations.size();ca++) {
+        const auto& bakedAnimation=model.bakedAnimations[ca];
+        unsigned int numFrames=bakedAnimation.numFrames();
+        if(numFrames==0) {
+            samples.emplace_back(ca, 0.0, false);
+            continue;
+        }
+        for(unsigned int cs=0;cs<options.numSamples;cs++) {
+            unsigned int frame=cs*numFrames/options.numSamples;
+            samples.emplace_back(ca, frame/bakedAnimation.framesPerSecond, false);
+        }
+        if(numFrames<2)
+            continue;
+        for(unsigned int cs=0;cs<options.numSamples;cs++) {
+            unsigned int frame=cs*(numFrames-1)/options.numSamples;
+            samples.emplace_back(ca, (frame+0.25)/bakedAnimation.framesPerSecond, true);
+        }
+    }
+
+    std::vector<ReferenceFrame> linearReferences(samples.size()), dualQuaternionReferences(samples.size());
+    Pose pose=model.createPose();
+    for(unsigned int cs=0;cs<samples.size();cs++) {
+        model.createFrame(pose, samples[cs].animationId, samples[cs].time);
+        skinLinearReference(model, pose, linearReferences[cs]);
+        skinDualQuaternionReference(model, pose, dualQuaternionReferences[cs]);
+    }
+
+    //The bone weights backend skins copies of the meshes without bone influences
+    std::vector<MeshExtended> boneWeightsMeshes=model.meshes;
+    for(auto& mesh: boneWeightsMeshes)
+        mesh.boneInfluenceWeights.clear();
+    SkinnedModel dualQuaternionModel=model;
+    dualQuaternionModel.dualQuaternionSkinning=true;
+
+#if defined(SKELETAL_ANIMATION_MODEL_SSE)
+    std::string influences="influences_sse";
+#elif defined(SKELETAL_ANIMATION_MODEL_NEON)
+    std::string influences="influences_neon";
+#else
+    std::string influences="influences_scalar";
+#endif
+    std::vector<Backend> backends;
+    backends.emplace_back(cpuBackend("bone_weights", model, boneWeightsMeshes, false));
+    backends.emplace_back(cpuBackend(influences, model, model.meshes, false));
+    backends.emplace_back(cpuBackend("dual_quaternion", dualQuaternionModel, dualQuaternionModel.meshes, false));
+    backends.emplace_back(cpuBackend("baked", model, model.meshes, true));
+
+#ifdef SKINNING_REGRESSION_GPU
+    //Read again with the buffers and shaders created, see SkeletalAnimationModel::transformFeedbackSkinning
+    SkinnedModel gpuModel, gpuDualQuaternionModel;
+    if(gpu) {
+        gpuModel.gpuSkinning=gpuModel.transformFeedbackSkinning=true;
+        gpuModel.read(report.filename);
+        backends.emplace_back(gpuBackend("gpu", gpuModel));
+        gpuDualQuaternionModel.gpuSkinning=gpuDualQuaternionModel.transformFeedbackSkinning=gpuDualQuaternionModel.dualQuaternionSkinning=true;
+        gpuDualQuaternionModel.read(report.filename);
+        backends.emplace_back(gpuBackend("gpu_dual_quaternion", gpuDualQuaternionModel));
+    }
+#endif
+
+    for(auto& backend: backends)
+        report.results.emplace_back(run(options, backend, samples, linearReferences, dualQuaternionReferences, report.numVertices, report.size));
+}
+
+//Writes value as a JSON string
+void writeString(FILE* file, const std::string& value) {
+    std::fputc('"', file);
+    for(char c: value) {
+        if(c=='"' || c=='\\')
+            std::fputc('\\', file);
+        if(static_cast<unsigned char>(c)>=0x20)
+            std::fputc(c, file);
+    }
+    std::fputc('"', file);
+}
+
+bool writeReport(const std::string& filename, const Options& options, const std::string& simd, const std::string& gpu, bool passed,
+                 const std::vector<ModelReport>& reports) {
+    FILE* file=std::fopen(filename.c_str(), "w");
+    if(!file)
+        return false;
+    std::fprintf(file, "{\n  \"simd\": ");
+    writeString(file, simd);
+    std::fprintf(file, ",\n  \"gpu\": ");
+    writeString(file, gpu);
+    std::fprintf(file, ",\n  \"samples_per_animation\": %u,\n  \"position_tolerance\": %g,\n  \"normal_tolerance\": %g,\n"
+                 "  \"interpolated_position_tolerance\": %g,\n  \"interpolated_normal_tolerance\": %g,\n  \"passed\": %s,\n  \"models\": [",
+                 options.numSamples, options.positionTolerance, options.normalTolerance,
+                 options.interpolatedPositionTolerance, options.interpolatedNormalTolerance, passed ? "true" : "false");
+    for(unsigned int cr=0;cr<reports.size();cr++) {
+        const auto& report=reports[cr];
+        std::fprintf(file, "%s\n    {\n      \"file\": ", cr>0 ? "," : "");
+        writeString(file, report.filename);
+        if(!report.error.empty()) {
+            std::fprintf(file, ",\n      \"error\": ");
+            writeString(file, report.error);
+        }
+        std::fprintf(file, ",\n      \"meshes\": %zu,\n      \"vertices\": %zu,\n      \"bones\": %zu,\n      \"animations\": %zu,\n      \"size\": %.9g,\n      \"backends\": [",
+                     report.numMeshes, report.numVertices, report.numBones, report.numAnimations, report.size);
+        for(unsigned int cb=0;cb<report.results.size();cb++) {
+            const auto& result=report.results[cb];
+            std::fprintf(file, "%s\n        {\"name\": ", cb>0 ? "," : "");
+            writeString(file, result.backend);
+            std::fprintf(file, ", \"reference\": ");
+            writeString(file, result.reference);
+            std::fprintf(file, ", \"samples\": %u, \"max_position_error\": %.9g, \"max_normal_error\": %.9g, ",
+                         result.numSamples, result.maxPositionError, result.maxNormalError);
+            if(result.numInterpolatedSamples>0)
+                std::fprintf(file, "\"interpolated_samples\": %u, \"max_interpolated_position_error\": %.9g, \"max_interpolated_normal_error\": %.9g, ",
+                             result.numInterpolatedSamples, result.maxInterpolatedPositionError, result.maxInterpolatedNormalError);
+            std::fprintf(file, "\"passed\": %s, \"vertices_per_second\": %.6g, \"instances_per_frame\": %.6g}",
+                         result.passed ? "true" : "false", result.verticesPerSecond, result.instancesPerFrame);
+        }
+        std::fprintf(file, "\n      ]\n    }");
+    }
+    std::fprintf(file, "\n  ]\n}\n");
+    return std::fclose(file)==0;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if(!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+#if defined(SKELETAL_ANIMATION_MODEL_SSE)
+    std::string simd="sse";
+#elif defined(SKELETAL_ANIMATION_MODEL_NEON)
+    std::string simd="neon";
+#else
+    std::string simd="none";
+#endif
+    std::string gpu="not built";
+    bool hasGpu=false;
+#ifdef SKINNING_REGRESSION_GPU
+    //Offscreen OpenGL context, current until the end of main
+    std::unique_ptr<sf::Context> context;
+    if(options.gpu) {
+        context.reset(new sf::Context());
+        hasGpu=hasTransformFeedback();
+        const char* version=reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        gpu=hasGpu ? version : "no transform feedback";
+    }
+    else
+        gpu="disabled";
+#endif
+
+    std::vector<ModelReport> reports(options.models.size());
+    bool passed=true;
+    std::printf("%-32s %-20s %-16s %8s %14s %14s %12s %12s\n", "model", "backend", "reference", "result", "position error", "normal error",
+                "Mvertices/s", "instances/f");
+    for(unsigned int cm=0;cm<options.models.size();cm++) {
+        auto& report=reports[cm];
+        report.filename=options.models[cm];
+        try {
+            runModel(options, hasGpu, report);
+        }
+        catch(const std::exception& exception) {
+            report.error=exception.what();
+        }
+        if(!report.error.empty()) {
+            std::printf("%-32s error: %s\n", report.filename.c_str(), report.error.c_str());
+            passed=false;
+            continue;
+        }
+        for(auto& result: report.results) {
+            std::printf("%-32s %-20s %-16s %8s %14.3g %14.3g %12.1f %12.1f\n", report.filename.c_str(), result.backend.c_str(), result.reference.c_str(),
+                        result.passed ? "ok" : "FAILED", result.maxPositionError, result.maxNormalError, result.verticesPerSecond/1e6, result.instancesPerFrame);
+            if(result.numInterpolatedSamples>0)
+                std::printf("%-32s %-20s %-16s %8s %14.3g %14.3g\n", report.filename.c_str(), (result.backend+" between frames").c_str(), result.reference.c_str(),
+                            "", result.maxInterpolatedPositionError, result.maxInterpolatedNormalError);
+            passed=passed && result.passed;
+        }
+    }
+    std::printf("simd: %s, gpu: %s\n%s\n", simd.c_str(), gpu.c_str(), passed ? "all backends match their references" : "some backends do not match their references");
+
+    if(!options.reportFilename.empty() && !writeReport(options.reportFilename, options, simd, gpu, passed, reports)) {
+        std::printf("could not write %s\n", options.reportFilename.c_str());
+        return 1;
+    }
+    return passed ? 0 : 1;
+}